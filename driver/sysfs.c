@@ -88,8 +88,8 @@ static ssize_t cell_stats_show(struct kobject *kobj,
 {
 	struct jailhouse_cpu_stats_attr *stats_attr =
 		container_of(attr, struct jailhouse_cpu_stats_attr, kattr);
-	unsigned int code = JAILHOUSE_CPU_INFO_STAT_BASE + stats_attr->code;
 	struct cell *cell = container_of(kobj, struct cell, stats_kobj);
+	unsigned int code = stats_attr->code;
 	unsigned long sum = 0;
 	unsigned int cpu;
 	int value;
@@ -104,18 +104,38 @@ static ssize_t cell_stats_show(struct kobject *kobj,
 	return sprintf(buffer, "%lu\n", sum);
 }
 
+#ifdef CONFIG_X86
+static ssize_t cell_info_show(struct kobject *kobj,
+			      struct kobj_attribute *attr,
+			      char *buffer)
+{
+	struct jailhouse_cpu_stats_attr *stats_attr =
+		container_of(attr, struct jailhouse_cpu_stats_attr, kattr);
+	struct cell *cell = container_of(kobj, struct cell, stats_kobj);
+	int value;
+
+	/* the value covers the whole cell, so ask via any of its CPUs */
+	value = jailhouse_call_arg2(JAILHOUSE_HC_CPU_GET_INFO,
+				    cpumask_first(&cell->cpus_assigned),
+				    stats_attr->code);
+	if (value < 0)
+		value = 0;
+
+	return sprintf(buffer, "%d\n", value);
+}
+#endif
+
 static ssize_t cpu_stats_show(struct kobject *kobj,
 			      struct kobj_attribute *attr,
 			      char *buffer)
 {
 	struct jailhouse_cpu_stats_attr *stats_attr =
 		container_of(attr, struct jailhouse_cpu_stats_attr, kattr);
-	unsigned int code = JAILHOUSE_CPU_INFO_STAT_BASE + stats_attr->code;
 	struct cell_cpu *cell_cpu = container_of(kobj, struct cell_cpu, kobj);
 	int value;
 
 	value = jailhouse_call_arg2(JAILHOUSE_HC_CPU_GET_INFO, cell_cpu->cpu,
-				    code);
+				    stats_attr->code);
 	if (value < 0)
 		value = 0;
 
@@ -125,6 +145,17 @@ static ssize_t cpu_stats_show(struct kobject *kobj,
 #define JAILHOUSE_CPU_STATS_ATTR(_name, _code) \
 	static struct jailhouse_cpu_stats_attr _name##_cell_attr = { \
 		.kattr = __ATTR(_name, S_IRUGO, cell_stats_show, NULL), \
+		.code = JAILHOUSE_CPU_INFO_STAT_BASE + _code, \
+	}; \
+	static struct jailhouse_cpu_stats_attr _name##_cpu_attr = { \
+		.kattr = __ATTR(_name, S_IRUGO, cpu_stats_show, NULL), \
+		.code = JAILHOUSE_CPU_INFO_STAT_BASE + _code, \
+	}
+
+/* cell-wide values, reported identically for each CPU of the cell */
+#define JAILHOUSE_CELL_INFO_ATTR(_name, _code) \
+	static struct jailhouse_cpu_stats_attr _name##_cell_attr = { \
+		.kattr = __ATTR(_name, S_IRUGO, cell_info_show, NULL), \
 		.code = _code, \
 	}; \
 	static struct jailhouse_cpu_stats_attr _name##_cpu_attr = { \
@@ -138,6 +169,9 @@ JAILHOUSE_CPU_STATS_ATTR(vmexits_management,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MANAGEMENT);
 JAILHOUSE_CPU_STATS_ATTR(vmexits_hypercall,
 			 JAILHOUSE_CPU_STAT_VMEXITS_HYPERCALL);
+JAILHOUSE_CPU_STATS_ATTR(mmio_cache_hits, JAILHOUSE_CPU_STAT_MMIO_CACHE_HITS);
+JAILHOUSE_CPU_STATS_ATTR(mmio_cache_misses,
+			 JAILHOUSE_CPU_STAT_MMIO_CACHE_MISSES);
 #ifdef CONFIG_X86
 JAILHOUSE_CPU_STATS_ATTR(vmexits_pio, JAILHOUSE_CPU_STAT_VMEXITS_PIO);
 JAILHOUSE_CPU_STATS_ATTR(vmexits_xapic, JAILHOUSE_CPU_STAT_VMEXITS_XAPIC);
@@ -150,6 +184,13 @@ JAILHOUSE_CPU_STATS_ATTR(vmexits_msr_other,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MSR_OTHER);
 JAILHOUSE_CPU_STATS_ATTR(vmexits_msr_x2apic_icr,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MSR_X2APIC_ICR);
+JAILHOUSE_CPU_STATS_ATTR(mmio_decode_hits,
+			 JAILHOUSE_CPU_STAT_MMIO_DECODE_HITS);
+JAILHOUSE_CPU_STATS_ATTR(mmio_decode_misses,
+			 JAILHOUSE_CPU_STAT_MMIO_DECODE_MISSES);
+JAILHOUSE_CELL_INFO_ATTR(llc_occupancy_kb, JAILHOUSE_CPU_INFO_LLC_OCCUPANCY);
+JAILHOUSE_CELL_INFO_ATTR(mbm_total_mb, JAILHOUSE_CPU_INFO_MBM_TOTAL);
+JAILHOUSE_CELL_INFO_ATTR(mbm_local_mb, JAILHOUSE_CPU_INFO_MBM_LOCAL);
 #elif defined(CONFIG_ARM) || defined(CONFIG_ARM64)
 JAILHOUSE_CPU_STATS_ATTR(vmexits_maintenance,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MAINTENANCE);
@@ -167,6 +208,8 @@ static struct attribute *cell_stats_attrs[] = {
 	&vmexits_mmio_cell_attr.kattr.attr,
 	&vmexits_management_cell_attr.kattr.attr,
 	&vmexits_hypercall_cell_attr.kattr.attr,
+	&mmio_cache_hits_cell_attr.kattr.attr,
+	&mmio_cache_misses_cell_attr.kattr.attr,
 #ifdef CONFIG_X86
 	&vmexits_pio_cell_attr.kattr.attr,
 	&vmexits_xapic_cell_attr.kattr.attr,
@@ -176,6 +219,11 @@ static struct attribute *cell_stats_attrs[] = {
 	&vmexits_exception_cell_attr.kattr.attr,
 	&vmexits_msr_other_cell_attr.kattr.attr,
 	&vmexits_msr_x2apic_icr_cell_attr.kattr.attr,
+	&mmio_decode_hits_cell_attr.kattr.attr,
+	&mmio_decode_misses_cell_attr.kattr.attr,
+	&llc_occupancy_kb_cell_attr.kattr.attr,
+	&mbm_total_mb_cell_attr.kattr.attr,
+	&mbm_local_mb_cell_attr.kattr.attr,
 #elif defined(CONFIG_ARM) || defined(CONFIG_ARM64)
 	&vmexits_maintenance_cell_attr.kattr.attr,
 	&vmexits_virt_irq_cell_attr.kattr.attr,
@@ -200,6 +248,8 @@ static struct attribute *cpu_stats_attrs[] = {
 	&vmexits_mmio_cpu_attr.kattr.attr,
 	&vmexits_management_cpu_attr.kattr.attr,
 	&vmexits_hypercall_cpu_attr.kattr.attr,
+	&mmio_cache_hits_cpu_attr.kattr.attr,
+	&mmio_cache_misses_cpu_attr.kattr.attr,
 #ifdef CONFIG_X86
 	&vmexits_pio_cpu_attr.kattr.attr,
 	&vmexits_xapic_cpu_attr.kattr.attr,
@@ -209,6 +259,11 @@ static struct attribute *cpu_stats_attrs[] = {
 	&vmexits_exception_cpu_attr.kattr.attr,
 	&vmexits_msr_other_cpu_attr.kattr.attr,
 	&vmexits_msr_x2apic_icr_cpu_attr.kattr.attr,
+	&mmio_decode_hits_cpu_attr.kattr.attr,
+	&mmio_decode_misses_cpu_attr.kattr.attr,
+	&llc_occupancy_kb_cpu_attr.kattr.attr,
+	&mbm_total_mb_cpu_attr.kattr.attr,
+	&mbm_local_mb_cpu_attr.kattr.attr,
 #elif defined(CONFIG_ARM) || defined(CONFIG_ARM64)
 	&vmexits_maintenance_cpu_attr.kattr.attr,
 	&vmexits_virt_irq_cpu_attr.kattr.attr,
@@ -521,6 +576,19 @@ static ssize_t mem_pool_used_show(struct device *dev,
 	return info_show(dev, buffer, JAILHOUSE_INFO_MEM_POOL_USED);
 }
 
+static ssize_t mem_pool_dirty_show(struct device *dev,
+				   struct device_attribute *attr, char *buffer)
+{
+	return info_show(dev, buffer, JAILHOUSE_INFO_MEM_POOL_DIRTY);
+}
+
+static ssize_t mem_pool_cached_show(struct device *dev,
+				    struct device_attribute *attr,
+				    char *buffer)
+{
+	return info_show(dev, buffer, JAILHOUSE_INFO_MEM_POOL_CACHED);
+}
+
 static ssize_t remap_pool_size_show(struct device *dev,
 				    struct device_attribute *attr,
 				    char *buffer)
@@ -547,6 +615,8 @@ static DEVICE_ATTR_RO(console);
 static DEVICE_ATTR_RO(enabled);
 static DEVICE_ATTR_RO(mem_pool_size);
 static DEVICE_ATTR_RO(mem_pool_used);
+static DEVICE_ATTR_RO(mem_pool_dirty);
+static DEVICE_ATTR_RO(mem_pool_cached);
 static DEVICE_ATTR_RO(remap_pool_size);
 static DEVICE_ATTR_RO(remap_pool_used);
 
@@ -555,6 +625,8 @@ static struct attribute *jailhouse_sysfs_entries[] = {
 	&dev_attr_enabled.attr,
 	&dev_attr_mem_pool_size.attr,
 	&dev_attr_mem_pool_used.attr,
+	&dev_attr_mem_pool_dirty.attr,
+	&dev_attr_mem_pool_cached.attr,
 	&dev_attr_remap_pool_size.attr,
 	&dev_attr_remap_pool_used.attr,
 	NULL
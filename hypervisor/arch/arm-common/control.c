@@ -217,6 +217,11 @@ void arch_config_commit(struct cell *cell_added_removed)
 	iommu_config_commit(cell_added_removed);
 }
 
+int arch_cpu_get_info(unsigned int cpu_id, unsigned long type)
+{
+	return -EINVAL;
+}
+
 void __attribute__((noreturn)) arch_panic_stop(void)
 {
 	asm volatile ("1: wfi; b 1b");
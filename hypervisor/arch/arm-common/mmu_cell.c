@@ -73,6 +73,17 @@ unsigned long arch_paging_gphys2phys(unsigned long gphys, unsigned long flags)
 	return paging_virt2phys(&this_cell()->arch.mm, gphys, flags);
 }
 
+const struct paging_structures *arch_paging_cell_structs(struct cell *cell)
+{
+	return &cell->arch.mm;
+}
+
+bool arch_paging_cell_structs_shared(struct cell *cell)
+{
+	/* SMMUs always use the stage-2 tables, nothing to compare against */
+	return false;
+}
+
 void arm_cell_dcaches_flush(struct cell *cell, enum dcache_flush flush)
 {
 	unsigned long region_addr, region_size, size;
@@ -221,6 +221,27 @@ static inline void arch_paging_flush_page_tlbs(unsigned long page_addr)
 	}
 }
 
+/* Above this number of pages, invalidating all hypervisor entries is cheaper */
+#define TLB_FLUSH_CEILING	32
+
+/* Only executed on hypervisor paging struct changes */
+static inline void arch_paging_flush_tlbs(unsigned long start,
+					  unsigned long pages)
+{
+	/* See arch_paging_flush_page_tlbs */
+	if (!is_el2())
+		return;
+
+	dsb();
+	if (pages > TLB_FLUSH_CEILING)
+		arm_write_sysreg(TLBIALLH, 0);
+	else
+		for (; pages > 0; pages--, start += PAGE_SIZE)
+			arm_write_sysreg(TLBIMVAH, start & PAGE_MASK);
+	dsb();
+	isb();
+}
+
 /* Used to clean the PAGING_COHERENT page table changes */
 static inline void arch_paging_flush_cpu_caches(void *addr, long size)
 {
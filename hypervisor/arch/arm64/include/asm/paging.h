@@ -147,6 +147,10 @@
 /* Memory Model Feature Register 0 */
 #define ID_AA64MMFR0_PARANGE_SHIFT	0
 
+/* Instruction Set Attribute Register 0 */
+#define ID_AA64ISAR0_TLB_SHIFT		56
+#define ID_AA64ISAR0_TLB_RANGE		2
+
 /* Macros used by the core, only for the EL2 stage-1 mappings */
 #define PAGE_FLAG_FRAMEBUFFER	S1_PTE_FLAG_DEVICE
 #define PAGE_FLAG_DEVICE	S1_PTE_FLAG_DEVICE
@@ -223,6 +227,8 @@ static inline void arch_paging_flush_page_tlbs(unsigned long page_addr)
 		: : "r" (page_addr >> PAGE_SHIFT));
 }
 
+void arch_paging_flush_tlbs(unsigned long start, unsigned long pages);
+
 /* Used to clean the PAGE_MAP_COHERENT page table changes */
 static inline void arch_paging_flush_cpu_caches(void *addr, long size)
 {
@@ -68,6 +68,9 @@
 #define SCTLR_EE_BIT	(1 << 25)
 #define SCTLR_UCI_BIT	(1 << 26)
 
+#define DCZID_BS_MASK	0xf
+#define DCZID_DZP_BIT	(1 << 4)
+
 #define SCTLR_EL1_RES1	((1 << 11) | (1 << 20) | (3 << 22) | (3 << 28))
 #define SCTLR_EL2_RES1	((3 << 4) | (1 << 11) | (1 << 16) | (1 << 18)	\
 			| (3 << 22) | (3 << 28))
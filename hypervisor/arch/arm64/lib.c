@@ -0,0 +1,70 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2024
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/paging.h>
+#include <jailhouse/string.h>
+#include <asm/sysregs.h>
+
+/*
+ * Pair loads and stores are only used if all pointers are 8-byte aligned.
+ * The functions may also be used on device memory where unaligned accesses
+ * would fault.
+ */
+
+void *memcpy(void *dest, const void *src, size_t n)
+{
+	unsigned long d = (unsigned long)dest, s = (unsigned long)src;
+	u64 t0, t1, t2, t3;
+
+	if (((d | s) & 7) == 0)
+		for (; n >= 32; n -= 32, d += 32, s += 32)
+			asm volatile("ldp %0, %1, [%4]\n\t"
+				     "ldp %2, %3, [%4, #16]\n\t"
+				     "stp %0, %1, [%5]\n\t"
+				     "stp %2, %3, [%5, #16]"
+				     : "=&r" (t0), "=&r" (t1), "=&r" (t2),
+				       "=&r" (t3)
+				     : "r" (s), "r" (d)
+				     : "memory");
+
+	for (; n > 0; n--)
+		*(u8 *)d++ = *(const u8 *)s++;
+	return dest;
+}
+
+void *memset(void *s, int c, size_t n)
+{
+	u64 pattern = 0x0101010101010101UL * (u8)c;
+	unsigned long p = (unsigned long)s;
+	unsigned long dczid, block_size;
+
+	/* Clear whole pages via DC ZVA if the CPU permits it. */
+	if (c == 0 && ((p | n) & PAGE_OFFS_MASK) == 0) {
+		arm_read_sysreg(DCZID_EL0, dczid);
+		if (!(dczid & DCZID_DZP_BIT)) {
+			block_size = 4UL << (dczid & DCZID_BS_MASK);
+			for (; n > 0; n -= block_size, p += block_size)
+				asm volatile("dc zva, %0"
+					     : : "r" (p) : "memory");
+			return s;
+		}
+	}
+
+	if ((p & 7) == 0)
+		for (; n >= 16; n -= 16, p += 16)
+			asm volatile("stp %0, %0, [%1]"
+				     : : "r" (pattern), "r" (p) : "memory");
+
+	for (; n > 0; n--)
+		*(u8 *)p++ = c;
+	return s;
+}
@@ -46,3 +46,75 @@ unsigned int get_cpu_parange(void)
 	return cpu_parange_encoded < ARRAY_SIZE(pa_bits) ?
 		pa_bits[cpu_parange_encoded] : 0;
 }
+
+/* Above this number of pages, invalidating all hypervisor entries is cheaper */
+#define TLB_FLUSH_CEILING		32
+
+/* Operand fields of TLBI range operations, assuming 4K granule */
+#define TLBI_RANGE_TG_4K		(1UL << 46)
+#define TLBI_RANGE_SCALE_SHIFT		44
+#define TLBI_RANGE_NUM_SHIFT		39
+#define TLBI_RANGE_BASE_MASK		BIT_MASK(36, 0)
+#define TLBI_RANGE_MAX_SCALE		3
+#define TLBI_RANGE_MAX_PAGES		(32UL << (5 * TLBI_RANGE_MAX_SCALE + 1))
+
+/* TLBI RVAE2, encoded as SYS to not depend on ARMv8.4 assembler support */
+#define tlbi_rvae2(arg)	asm volatile("sys #4, c8, c6, #1, %0" : : "r" (arg))
+
+/**
+ * Invalidate the TLB entries of a hypervisor address range.
+ * @param start		First virtual address of the range.
+ * @param pages		Number of pages in the range.
+ *
+ * Uses TLBI range operations if the CPU supports them and falls back to
+ * per-page or full invalidation otherwise.
+ */
+void arch_paging_flush_tlbs(unsigned long start, unsigned long pages)
+{
+	unsigned long isar0, num, count;
+	unsigned int scale = 0;
+	bool range_ops;
+
+	arm_read_sysreg(ID_AA64ISAR0_EL1, isar0);
+	range_ops = ((isar0 >> ID_AA64ISAR0_TLB_SHIFT) & 0xf) >=
+		ID_AA64ISAR0_TLB_RANGE;
+
+	if ((!range_ops && pages > TLB_FLUSH_CEILING) ||
+	    pages >= TLBI_RANGE_MAX_PAGES) {
+		asm volatile(
+			"dsb ish\n\t"
+			"tlbi alle2\n\t"
+			"dsb ish\n\t"
+			"isb\n\t");
+		return;
+	}
+
+	asm volatile("dsb ish");
+	while (pages > 0) {
+		/* Odd counts cannot be expressed by range operations. */
+		if (!range_ops || pages % 2) {
+			asm volatile("tlbi vae2, %0"
+				     : : "r" (start >> PAGE_SHIFT));
+			start += PAGE_SIZE;
+			pages--;
+			continue;
+		}
+
+		num = (pages >> (5 * scale + 1)) & 0x1f;
+		if (num > 0) {
+			tlbi_rvae2(TLBI_RANGE_TG_4K |
+				   ((unsigned long)scale <<
+				    TLBI_RANGE_SCALE_SHIFT) |
+				   ((num - 1) << TLBI_RANGE_NUM_SHIFT) |
+				   ((start >> PAGE_SHIFT) &
+				    TLBI_RANGE_BASE_MASK));
+			count = num << (5 * scale + 1);
+			start += count * PAGE_SIZE;
+			pages -= count;
+		}
+		scale++;
+	}
+	asm volatile(
+		"dsb ish\n\t"
+		"isb\n\t");
+}
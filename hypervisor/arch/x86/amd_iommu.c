@@ -28,6 +28,7 @@
 #include <asm/iommu.h>
 
 #define CAPS_IOMMU_HEADER_REG		0x00
+#define  CAPS_IOMMU_NP_CACHE		(1 << 26)
 #define  CAPS_IOMMU_EFR_SUP		(1 << 27)
 #define CAPS_IOMMU_BASE_LOW_REG		0x04
 #define  CAPS_IOMMU_ENABLE		(1 << 0)
@@ -106,6 +107,8 @@ union buf_entry {
 #define CMD_INV_IOMMU_PAGES		0x03
 # define CMD_INV_IOMMU_PAGES_SIZE	(1 << 0)
 # define CMD_INV_IOMMU_PAGES_PDE	(1 << 1)
+/* 2^52 pages cover the whole address range */
+# define CMD_INV_IOMMU_PAGES_ALL_ORDER	52
 
 #define EVENT_TYPE_ILL_DEV_TAB_ENTRY	0x01
 #define EVENT_TYPE_PAGE_TAB_HW_ERR	0x04
@@ -140,6 +143,10 @@ static struct amd_iommu {
 	void *devtable_segments[DEV_TABLE_SEG_MAX];
 	u8 dev_tbl_seg_sup;
 	u32 cmd_tail_ptr;
+	/* tail as last passed to the hardware */
+	u32 cmd_kick_ptr;
+	/* lower bound of the free command buffer space, in bytes */
+	u32 cmd_free;
 	bool he_supported;
 } iommu_units[JAILHOUSE_MAX_IOMMU_UNITS];
 
@@ -148,6 +155,8 @@ static struct amd_iommu {
 				   iommu++)
 
 static unsigned int iommu_units_count;
+/* set if some unit may cache non-present entries */
+static bool np_cache;
 
 bool iommu_cell_emulates_ir(struct cell *cell)
 {
@@ -168,29 +177,61 @@ static int amd_iommu_cell_init(struct cell *cell)
 
 static void amd_iommu_completion_wait(struct amd_iommu *iommu);
 
+/*
+ * Commands are only queued here. The hardware starts processing them when
+ * amd_iommu_kick() publishes the new tail, usually along with a completion
+ * wait, so that a whole batch costs one tail update and one wait.
+ */
 static void amd_iommu_submit_command(struct amd_iommu *iommu,
 				     union buf_entry *cmd, bool draining)
 {
-	u32 head, next_tail, bytes_free;
-	unsigned char *cur_ptr;
-
-	head = mmio_read64(iommu->mmio_base + AMD_CMD_BUF_HEAD_REG);
-	next_tail = (iommu->cmd_tail_ptr + sizeof(*cmd)) % CMD_BUF_SIZE;
-	bytes_free = (head - next_tail) % CMD_BUF_SIZE;
-
-	/* Leave space for COMPLETION_WAIT that drains the buffer. */
-	if (bytes_free < (2 * sizeof(*cmd)) && !draining)
-		/* Drain the buffer */
-		amd_iommu_completion_wait(iommu);
+	u32 head;
 
-	cur_ptr = &iommu->cmd_buf_base[iommu->cmd_tail_ptr];
-	memcpy(cur_ptr, cmd, sizeof(*cmd));
+	/*
+	 * Leave space for COMPLETION_WAIT that drains the buffer. Only
+	 * re-read the head if the space known to be free is insufficient.
+	 */
+	if (iommu->cmd_free < 2 * sizeof(*cmd) && !draining) {
+		head = mmio_read64(iommu->mmio_base + AMD_CMD_BUF_HEAD_REG);
+		iommu->cmd_free = (head - iommu->cmd_tail_ptr - sizeof(*cmd)) %
+			CMD_BUF_SIZE;
+		if (iommu->cmd_free < 2 * sizeof(*cmd))
+			/* Drain the buffer */
+			amd_iommu_completion_wait(iommu);
+	}
 
-	/* Just to be sure. */
-	arch_paging_flush_cpu_caches(cur_ptr, sizeof(*cmd));
+	memcpy(&iommu->cmd_buf_base[iommu->cmd_tail_ptr], cmd, sizeof(*cmd));
 
 	iommu->cmd_tail_ptr =
 		(iommu->cmd_tail_ptr + sizeof(*cmd)) % CMD_BUF_SIZE;
+	iommu->cmd_free -= sizeof(*cmd);
+}
+
+static void amd_iommu_flush_cmd_buf(struct amd_iommu *iommu, u32 start,
+				    u32 end)
+{
+	u32 offset = start % cache_line_size;
+
+	arch_paging_flush_cpu_caches(&iommu->cmd_buf_base[start - offset],
+				     end - start + offset);
+}
+
+/* Pass all queued commands to the hardware. */
+static void amd_iommu_kick(struct amd_iommu *iommu)
+{
+	u32 tail = iommu->cmd_tail_ptr;
+
+	/* Flush the commands queued since the last kick, just to be sure. */
+	if (tail < iommu->cmd_kick_ptr) {
+		amd_iommu_flush_cmd_buf(iommu, iommu->cmd_kick_ptr,
+					CMD_BUF_SIZE);
+		amd_iommu_flush_cmd_buf(iommu, 0, tail);
+	} else {
+		amd_iommu_flush_cmd_buf(iommu, iommu->cmd_kick_ptr, tail);
+	}
+
+	mmio_write64(iommu->mmio_base + AMD_CMD_BUF_TAIL_REG, tail);
+	iommu->cmd_kick_ptr = tail;
 }
 
 u64 amd_iommu_get_memory_region_flags(const struct jailhouse_memory *mem)
@@ -218,6 +259,9 @@ int iommu_map_memory_region(struct cell *cell,
 	if (mem->virt_start & BIT_MASK(63, 48))
 		return trace_error(-E2BIG);
 
+	if (np_cache && mem->flags & JAILHOUSE_MEM_DMA)
+		iommu_queue_flush(cell, mem->virt_start, mem->size);
+
 	/* vcpu_map_memory_region already did the actual work. */
 	return 0;
 }
@@ -225,6 +269,9 @@ int iommu_map_memory_region(struct cell *cell,
 int iommu_unmap_memory_region(struct cell *cell,
 			      const struct jailhouse_memory *mem)
 {
+	if (mem->flags & JAILHOUSE_MEM_DMA)
+		iommu_queue_flush(cell, mem->virt_start, mem->size);
+
 	/* vcpu_map_memory_region already did the actual work. */
 	return 0;
 }
@@ -388,30 +435,74 @@ static void wait_for_zero(volatile u64 *sem, unsigned long mask)
 		cpu_relax();
 }
 
+/* Invalidate 2^order pages at addr, which has to be aligned accordingly. */
 static void amd_iommu_invalidate_pages(struct amd_iommu *iommu,
-				       u16 domain_id)
+				       u16 domain_id, u64 addr,
+				       unsigned int order)
 {
 	union buf_entry invalidate_pages = {{ 0 }};
+	u32 flags = CMD_INV_IOMMU_PAGES_PDE;
 
 	/*
-	 * Flush everything, including PDEs, in whole address range, i.e.
-	 * 0x7ffffffffffff000 with S bit (see Sect. 2.2.3).
+	 * With the S bit, the lowest clear address bit starting from bit 12
+	 * encodes the size (see Sect. 2.2.3). The whole address range is
+	 * 0x7ffffffffffff000 with S bit.
 	 */
+	if (order > 0) {
+		flags |= CMD_INV_IOMMU_PAGES_SIZE;
+		if (order > 1)
+			addr |= BIT_MASK(PAGE_SHIFT + order - 2, PAGE_SHIFT);
+	}
+
 	invalidate_pages.raw32[1] = domain_id;
-	invalidate_pages.raw32[2] = 0xfffff000 | CMD_INV_IOMMU_PAGES_SIZE |
-		CMD_INV_IOMMU_PAGES_PDE;
-	invalidate_pages.raw32[3] = 0x7fffffff;
+	invalidate_pages.raw32[2] = (addr & BIT_MASK(31, PAGE_SHIFT)) | flags;
+	invalidate_pages.raw32[3] = addr >> 32;
 	invalidate_pages.type = CMD_INV_IOMMU_PAGES;
 
 	amd_iommu_submit_command(iommu, &invalidate_pages, false);
 }
 
-static void amd_iommu_completion_wait(struct amd_iommu *iommu)
+struct amd_iommu_inv_request {
+	struct amd_iommu *iommu;
+	u16 domain_id;
+};
+
+static void amd_iommu_queue_inv_block(void *arg, u64 addr, unsigned int order)
 {
-	long addr = paging_hvirt2phys(&per_cpu(this_cpu_id())->amd_iommu_sem);
+	struct amd_iommu_inv_request *req = arg;
+
+	amd_iommu_invalidate_pages(req->iommu, req->domain_id, addr, order);
+}
+
+/*
+ * Invalidate the translations of the ranges queued for the cell, falling
+ * back to its whole domain if that is cheaper or required.
+ */
+static void amd_iommu_flush_domain(struct amd_iommu *iommu, struct cell *cell)
+{
+	struct amd_iommu_inv_request req = {
+		.iommu = iommu,
+		.domain_id = cell->config->id & 0xffff,
+	};
+
+	if (!iommu_flush_queued_blocks(cell, CMD_INV_IOMMU_PAGES_ALL_ORDER - 1,
+				       amd_iommu_queue_inv_block, &req))
+		amd_iommu_invalidate_pages(iommu, req.domain_id, 0,
+					   CMD_INV_IOMMU_PAGES_ALL_ORDER);
+}
+
+/*
+ * Queue a COMPLETION_WAIT and pass the buffer to the hardware without waiting
+ * for it. Each unit signals completion via its own semaphore so that all
+ * units can work in parallel.
+ */
+static void amd_iommu_start_completion_wait(struct amd_iommu *iommu)
+{
+	long addr = paging_hvirt2phys(
+		&per_cpu(this_cpu_id())->amd_iommu_sem[iommu->idx]);
 	union buf_entry completion_wait = {{ 0 }};
 
-	this_cpu_data()->amd_iommu_sem = 1;
+	this_cpu_data()->amd_iommu_sem[iommu->idx] = 1;
 
 	completion_wait.raw32[0] = (addr & BIT_MASK(31, 3)) |
 		CMD_COMPL_WAIT_STORE;
@@ -419,10 +510,21 @@ static void amd_iommu_completion_wait(struct amd_iommu *iommu)
 	completion_wait.type = CMD_COMPL_WAIT;
 
 	amd_iommu_submit_command(iommu, &completion_wait, true);
-	mmio_write64(iommu->mmio_base + AMD_CMD_BUF_TAIL_REG,
-		     iommu->cmd_tail_ptr);
+	amd_iommu_kick(iommu);
+}
+
+static void amd_iommu_finish_completion_wait(struct amd_iommu *iommu)
+{
+	wait_for_zero(&this_cpu_data()->amd_iommu_sem[iommu->idx], -1);
 
-	wait_for_zero(&this_cpu_data()->amd_iommu_sem, -1);
+	/* The hardware consumed all commands, i.e. head == tail. */
+	iommu->cmd_free = CMD_BUF_SIZE - sizeof(union buf_entry);
+}
+
+static void amd_iommu_completion_wait(struct amd_iommu *iommu)
+{
+	amd_iommu_start_completion_wait(iommu);
+	amd_iommu_finish_completion_wait(iommu);
 }
 
 static void amd_iommu_init_fault_nmi(void)
@@ -484,17 +586,24 @@ void iommu_config_commit(struct cell *cell_added_removed)
 	if (cell_added_removed)
 		amd_iommu_init_fault_nmi();
 
+	/* the cell's devices were attached or detached */
+	if (cell_added_removed)
+		iommu_queue_flush_all(cell_added_removed);
+
 	for_each_iommu(iommu) {
 		/* Flush caches */
-		if (cell_added_removed) {
-			amd_iommu_invalidate_pages(iommu,
-					cell_added_removed->config->id & 0xffff);
-			amd_iommu_invalidate_pages(iommu,
-					root_cell.config->id & 0xffff);
-		}
+		if (cell_added_removed)
+			amd_iommu_flush_domain(iommu, cell_added_removed);
+		amd_iommu_flush_domain(iommu, &root_cell);
 		/* Execute all commands in the buffer */
-		amd_iommu_completion_wait(iommu);
+		amd_iommu_start_completion_wait(iommu);
 	}
+	for_each_iommu(iommu)
+		amd_iommu_finish_completion_wait(iommu);
+
+	if (cell_added_removed)
+		iommu_reset_flush_queue(cell_added_removed);
+	iommu_reset_flush_queue(&root_cell);
 }
 
 struct apic_irq_message iommu_get_remapped_root_int(unsigned int iommu,
@@ -640,6 +749,8 @@ static int amd_iommu_init_pci(struct amd_iommu *entry,
 	caps_header = pci_read_config(iommu->amd.bdf, iommu->amd.base_cap, 4);
 	if (!(caps_header & CAPS_IOMMU_EFR_SUP))
 		return trace_error(-EIO);
+	if (caps_header & CAPS_IOMMU_NP_CACHE)
+		np_cache = true;
 
 	lo = pci_read_config(iommu->amd.bdf,
 			     iommu->amd.base_cap + CAPS_IOMMU_BASE_LOW_REG, 4);
@@ -750,6 +861,8 @@ static int amd_iommu_init_buffers(struct amd_iommu *entry,
 		     ((u64)CMD_BUF_LEN_EXPONENT << BUF_LEN_EXPONENT_SHIFT));
 
 	entry->cmd_tail_ptr = 0;
+	entry->cmd_kick_ptr = 0;
+	entry->cmd_free = CMD_BUF_SIZE - sizeof(union buf_entry);
 
 	/* Allocate and configure event log */
 	entry->evt_log_base = page_alloc(&mem_pool, PAGES(EVT_LOG_SIZE));
@@ -14,23 +14,106 @@
 #include <jailhouse/printk.h>
 #include <jailhouse/unit.h>
 #include <jailhouse/utils.h>
+#include <asm/apic.h>
 #include <asm/cat.h>
 
 #include <jailhouse/cell-config.h>
 
-#define CAT_ROOT_COS	0
+static struct {
+	const char *name;
+	bool supported;
+	unsigned int cbm_max;
+	u64 orig_root_mask, freed_mask;
+} partitions[CAT_NUM_PARTITIONS] = {
+	[CAT_L3_DATA] = { .name = "L3" },
+	[CAT_L3_CODE] = { .name = "L3 code" },
+	[CAT_L2] = { .name = "L2" },
+};
+
+/* Root cell masks of the L2 caches, see public_per_cpu::l2_cache_id. */
+struct l2_domain {
+	u32 id;
+	u64 root_mask, freed_mask;
+};
+
+static struct l2_domain *l2_domains;
+static unsigned int num_l2_domains;
 
-static unsigned int cbm_max;
 static int cos_max = -1;
-static u64 orig_root_mask, freed_mask;
+static int l3_cos_max = -1, l2_cos_max = -1;
+static bool cdp_supported, cdp_enabled;
+/* CDP was enabled by the root cell rather than on demand */
+static bool cdp_root_enabled;
+/* non-root cells with separate L3 code or data regions */
+static unsigned int cdp_cells;
+
+static struct l2_domain *get_l2_domain(u32 l2_cache_id)
+{
+	unsigned int n;
+
+	for (n = 0; n < num_l2_domains; n++)
+		if (l2_domains[n].id == l2_cache_id)
+			return &l2_domains[n];
+
+	return NULL;
+}
+
+static bool cell_shares_l2(struct cell *cell, const struct l2_domain *domain)
+{
+	unsigned int cpu;
+
+	for_each_cpu(cpu, cell->cpu_set)
+		if (public_per_cpu(cpu)->l2_cache_id == domain->id)
+			return true;
+
+	return false;
+}
+
+static u64 get_l2_mask(struct cell *cell)
+{
+	struct l2_domain *domain;
+
+	if (cell->arch.cos != CAT_ROOT_COS &&
+	    !(cell->arch.cat_inherited & (1 << CAT_L2)))
+		return cell->arch.cat_masks[CAT_L2];
+
+	/* the root cell's mask depends on the L2 this CPU is attached to */
+	domain = get_l2_domain(this_cpu_public()->l2_cache_id);
+	return domain ? domain->root_mask : root_cell.arch.cat_masks[CAT_L2];
+}
 
 void cat_update(void)
 {
 	struct cell *cell = this_cell();
+	const u64 *masks = cell->arch.cat_masks;
+	u32 cos = cell->arch.cos;
+	u64 qos_cfg;
+
+	/* cells without an own COS use the root cell's partitions */
+	if (cos == CAT_ROOT_COS)
+		masks = root_cell.arch.cat_masks;
 
 	write_msr(MSR_IA32_PQR_ASSOC,
-		  (u64)cell->arch.cos << PQR_ASSOC_COS_SHIFT);
-	write_msr(MSR_IA32_L3_MASK_0 + cell->arch.cos, cell->arch.cat_mask);
+		  (u64)cos << PQR_ASSOC_COS_SHIFT | cell->arch.rmid);
+
+	/* CDP is switched per package, before the masks are reinterpreted */
+	if (cdp_supported) {
+		qos_cfg = read_msr(MSR_IA32_L3_QOS_CFG);
+		if (!(qos_cfg & L3_QOS_CFG_CDP_ENABLE) != !cdp_enabled)
+			write_msr(MSR_IA32_L3_QOS_CFG,
+				  qos_cfg ^ L3_QOS_CFG_CDP_ENABLE);
+	}
+
+	if (cdp_enabled) {
+		/* CDP pairs the mask registers: data at even, code at odd */
+		write_msr(MSR_IA32_L3_MASK_0 + cos * 2, masks[CAT_L3_DATA]);
+		write_msr(MSR_IA32_L3_MASK_0 + cos * 2 + 1,
+			  masks[CAT_L3_CODE]);
+	} else if (partitions[CAT_L3_DATA].supported) {
+		write_msr(MSR_IA32_L3_MASK_0 + cos, masks[CAT_L3_DATA]);
+	}
+	if (partitions[CAT_L2].supported)
+		write_msr(MSR_IA32_L2_MASK_0 + cos, get_l2_mask(cell));
 }
 
 /* root cell has to be stopped */
@@ -45,6 +128,34 @@ static void cat_update_cell(struct cell *cell)
 			public_per_cpu(cpu)->update_cat = true;
 }
 
+/*
+ * Apply changes of the root cell's masks, including to the partitions of
+ * other cells that follow them. The root cell has to be stopped.
+ */
+static void update_root_cell(void)
+{
+	struct cell *cell;
+	unsigned int cpu, p;
+
+	for_each_non_root_cell(cell) {
+		if (!cell->arch.cat_inherited)
+			continue;
+
+		for (p = 0; p < CAT_NUM_PARTITIONS; p++)
+			if (cell->arch.cat_inherited & (1 << p))
+				cell->arch.cat_masks[p] =
+					root_cell.arch.cat_masks[p];
+
+		/* the cell keeps running, kick its CPUs */
+		for_each_cpu(cpu, cell->cpu_set) {
+			public_per_cpu(cpu)->update_cat = true;
+			apic_send_nmi_ipi(public_per_cpu(cpu));
+		}
+	}
+
+	cat_update_cell(&root_cell);
+}
+
 static u32 get_free_cos(void)
 {
 	struct cell *cell;
@@ -60,7 +171,7 @@ retry:
 	return cos;
 }
 
-static bool merge_freed_mask_to_root(void)
+static bool merge_freed_mask_to_root(u64 *root_mask, u64 *freed_mask)
 {
 	bool updated = false;
 	unsigned int n;
@@ -69,11 +180,10 @@ static bool merge_freed_mask_to_root(void)
 restart:
 	for (n = 0, bit = 1; n < 64; n++, bit <<= 1)
 		/* unless the root mask is empty, merge only neighboring bits */
-		if (freed_mask & bit && (root_cell.arch.cat_mask & (bit << 1) ||
-		     root_cell.arch.cat_mask & (bit >> 1) ||
-		     root_cell.arch.cat_mask == 0)) {
-			root_cell.arch.cat_mask |= bit;
-			freed_mask &= ~bit;
+		if (*freed_mask & bit && (*root_mask & (bit << 1) ||
+		     *root_mask & (bit >> 1) || *root_mask == 0)) {
+			*root_mask |= bit;
+			*freed_mask &= ~bit;
 			updated = true;
 
 			goto restart;
@@ -82,24 +192,24 @@ restart:
 	return updated;
 }
 
-static bool shrink_root_cell_mask(u64 cell_mask)
+static bool shrink_root_mask(u64 *root_mask, u64 *freed_mask, u64 cell_mask)
 {
 	unsigned int lo_mask_start, lo_mask_len;
 	u64 lo_mask;
 
-	if ((root_cell.arch.cat_mask & ~cell_mask) == 0) {
+	if ((*root_mask & ~cell_mask) == 0) {
 		/*
 		 * Try to refill the root mask from the freed mask. The root
 		 * mask must not become empty, so check this first.
 		 */
-		if (freed_mask == 0)
+		if (*freed_mask == 0)
 			return false;
 
-		root_cell.arch.cat_mask = 0;
-		merge_freed_mask_to_root();
+		*root_mask = 0;
+		merge_freed_mask_to_root(root_mask, freed_mask);
 	} else {
 		/* Shrink the root cell's mask. */
-		root_cell.arch.cat_mask &= ~cell_mask;
+		*root_mask &= ~cell_mask;
 
 		/*
 		 * Ensure that the root mask is still contiguous:
@@ -112,116 +222,448 @@ static bool shrink_root_cell_mask(u64 cell_mask)
 		 * Always removing the lower half simplifies this algorithm at
 		 * the price of possibly choosing the smaller sub-mask. Cell
 		 * configurations can avoid this by locating non-root cell
-		 * masks at the beginning of the L3 cache.
+		 * masks at the beginning of the cache.
 		 */
-		lo_mask_start = ffsl(root_cell.arch.cat_mask);
-		lo_mask_len = ffzl(root_cell.arch.cat_mask >> lo_mask_start);
+		lo_mask_start = ffsl(*root_mask);
+		lo_mask_len = ffzl(*root_mask >> lo_mask_start);
 		lo_mask = BIT_MASK(lo_mask_start + lo_mask_len - 1,
 				   lo_mask_start);
 
-		if (root_cell.arch.cat_mask & ~lo_mask) {
-			root_cell.arch.cat_mask &= ~lo_mask;
-			freed_mask |= lo_mask;
+		if (*root_mask & ~lo_mask) {
+			*root_mask &= ~lo_mask;
+			*freed_mask |= lo_mask;
 		}
 	}
 
-	printk("CAT: Shrunk root cell bitmask to %08llx\n",
-	       root_cell.arch.cat_mask);
-	cat_update_cell(&root_cell);
-
 	/* Drop this mask from the freed mask in case it was queued there. */
-	freed_mask &= ~cell_mask;
+	*freed_mask &= ~cell_mask;
 
 	return true;
 }
 
+/*
+ * Take a cell's mask out of the root cell's partition. L2 partitions are only
+ * shrunk on the caches that the cell's CPUs are attached to.
+ */
+static bool shrink_root_cell(struct cell *cell, unsigned int p, u64 cell_mask,
+			     bool *updated)
+{
+	u64 *root_mask = &root_cell.arch.cat_masks[p];
+	struct l2_domain *domain;
+
+	if (p != CAT_L2) {
+		if ((*root_mask & cell_mask) == 0)
+			return true;
+		if (!shrink_root_mask(root_mask, &partitions[p].freed_mask,
+				      cell_mask))
+			return false;
+
+		printk("CAT: Shrunk root cell %s bitmask to %08llx\n",
+		       partitions[p].name, *root_mask);
+		*updated = true;
+		return true;
+	}
+
+	for (domain = l2_domains; domain < l2_domains + num_l2_domains;
+	     domain++) {
+		if (!cell_shares_l2(cell, domain) ||
+		    (domain->root_mask & cell_mask) == 0)
+			continue;
+		if (!shrink_root_mask(&domain->root_mask, &domain->freed_mask,
+				      cell_mask))
+			return false;
+
+		printk("CAT: Shrunk root cell L2 bitmask of cache %d to "
+		       "%08llx\n", domain->id, domain->root_mask);
+		*updated = true;
+	}
+
+	return true;
+}
+
+/* Return L2 mask bits to the root cell on the caches the cell was using. */
+static bool release_l2_masks(struct cell *cell, u64 freed)
+{
+	struct l2_domain *domain;
+	bool updated = false;
+
+	for (domain = l2_domains; domain < l2_domains + num_l2_domains;
+	     domain++) {
+		if (!cell_shares_l2(cell, domain))
+			continue;
+
+		domain->freed_mask |= freed;
+		if (merge_freed_mask_to_root(&domain->root_mask,
+					     &domain->freed_mask)) {
+			printk("CAT: Extended root cell L2 bitmask of cache %d "
+			       "to %08llx\n", domain->id, domain->root_mask);
+			updated = true;
+		}
+	}
+
+	return updated;
+}
+
+/*
+ * Queue bits of released masks for returning to root that were in the
+ * original root mask as well. Returns true if the root cell's masks changed.
+ */
+static bool release_cell_masks(struct cell *cell, unsigned int owned)
+{
+	bool updated = false;
+	unsigned int p;
+	u64 freed;
+
+	for (p = 0; p < CAT_NUM_PARTITIONS; p++) {
+		if (!(owned & (1 << p)) || !partitions[p].supported)
+			continue;
+
+		freed = cell->arch.cat_masks[p] & partitions[p].orig_root_mask;
+
+		if (p == CAT_L2) {
+			if (release_l2_masks(cell, freed))
+				updated = true;
+			continue;
+		}
+
+		partitions[p].freed_mask |= freed;
+		if (merge_freed_mask_to_root(&root_cell.arch.cat_masks[p],
+					     &partitions[p].freed_mask)) {
+			printk("CAT: Extended root cell %s bitmask to %08llx\n",
+			       partitions[p].name,
+			       root_cell.arch.cat_masks[p]);
+			updated = true;
+		}
+	}
+
+	return updated;
+}
+
+static int get_cos_max(bool cdp)
+{
+	/* CDP halves the number of COS */
+	int max = cdp ? (l3_cos_max + 1) / 2 - 1 : l3_cos_max;
+
+	if (l2_cos_max >= 0 && (max < 0 || l2_cos_max < max))
+		max = l2_cos_max;
+	return max;
+}
+
+/* Check if the cell defines separate L3 code or data regions. */
+static bool cell_splits_l3(struct cell *cell)
+{
+	const struct jailhouse_cache *cache =
+		jailhouse_cell_cache_regions(cell->config);
+	unsigned int n;
+
+	for (n = 0; n < cell->config->num_cache_regions; n++, cache++)
+		if (cache->type == JAILHOUSE_CACHE_L3_CODE ||
+		    cache->type == JAILHOUSE_CACHE_L3_DATA)
+			return true;
+
+	return false;
+}
+
+/*
+ * Switch between unified and separate L3 code and data masks. Existing masks
+ * are taken over for both code and data. The CPUs reprogram their packages
+ * on their next update. The root cell has to be stopped.
+ */
+static void set_cdp(bool enable)
+{
+	struct cell *cell;
+	unsigned int cpu;
+
+	cdp_enabled = enable;
+	cos_max = get_cos_max(enable);
+
+	partitions[CAT_L3_DATA].name = enable ? "L3 data" : "L3";
+	partitions[CAT_L3_CODE].supported = enable;
+	if (enable) {
+		partitions[CAT_L3_CODE].orig_root_mask =
+			partitions[CAT_L3_DATA].orig_root_mask;
+		partitions[CAT_L3_CODE].freed_mask =
+			partitions[CAT_L3_DATA].freed_mask;
+	}
+
+	for_each_cell(cell) {
+		if (enable) {
+			cell->arch.cat_masks[CAT_L3_CODE] =
+				cell->arch.cat_masks[CAT_L3_DATA];
+			if (cell->arch.cat_inherited & (1 << CAT_L3_DATA))
+				cell->arch.cat_inherited |= 1 << CAT_L3_CODE;
+		} else {
+			cell->arch.cat_inherited &= ~(1 << CAT_L3_CODE);
+		}
+
+		if (cell == &root_cell)
+			continue;
+
+		/* the cell keeps running, kick its CPUs */
+		for_each_cpu(cpu, cell->cpu_set) {
+			if (public_per_cpu(cpu)->cell != cell)
+				continue;
+			public_per_cpu(cpu)->update_cat = true;
+			apic_send_nmi_ipi(public_per_cpu(cpu));
+		}
+	}
+	cat_update_cell(&root_cell);
+
+	printk("CAT: %s code/data prioritization\n",
+	       enable ? "Enabled" : "Disabled");
+}
+
+/* Return the partitions a cache region type refers to. */
+static unsigned int region_partitions(u8 type)
+{
+	switch (type) {
+	case JAILHOUSE_CACHE_L3:
+		return (1 << CAT_L3_DATA) |
+			(cdp_enabled ? (1 << CAT_L3_CODE) : 0);
+	/* without CDP, code and data cannot be told apart */
+	case JAILHOUSE_CACHE_L3_CODE:
+		return cdp_enabled ? (1 << CAT_L3_CODE) : 0;
+	case JAILHOUSE_CACHE_L3_DATA:
+		return cdp_enabled ? (1 << CAT_L3_DATA) : 0;
+	case JAILHOUSE_CACHE_L2:
+		return 1 << CAT_L2;
+	default:
+		return 0;
+	}
+}
+
 static int cat_cell_init(struct cell *cell)
 {
 	const struct jailhouse_cache *cache;
+	unsigned int n, p, regions, owned = 0;
+	bool root_updated = false, split;
+	struct cell *other;
+	u64 mask;
 
 	cell->arch.cos = CAT_ROOT_COS;
+	cell->arch.cat_inherited = 0;
 
 	/* NOTE: the EBUSY check below relies on this */
 	if (cos_max < 0)
 		return 0;
 
-	if (cell->config->num_cache_regions > 0) {
-		if (cell != &root_cell) {
-			cell->arch.cos = get_free_cos();
-			if (cell->arch.cos > (u32)cos_max)
-				return trace_error(-EBUSY);
-		}
-
-		cache = jailhouse_cell_cache_regions(cell->config);
+	/* bandwidth allocation is also bound to the COS */
+	if ((cell->config->num_cache_regions > 0 ||
+	     cell->config->mem_bandwidth > 0) && cell != &root_cell) {
+		cell->arch.cos = get_free_cos();
+		if (cell->arch.cos > (u32)cos_max)
+			return trace_error(-EBUSY);
+	}
 
-		if (cell->config->num_cache_regions != 1 ||
-		    cache->type != JAILHOUSE_CACHE_L3 ||
-		    cache->size == 0 ||
-		    (cache->start + cache->size - 1) > cbm_max)
-			return trace_error(-EINVAL);
+	/*
+	 * Separate L3 code and data regions of non-root cells enable CDP on
+	 * demand, provided that all COS in use stay available with it.
+	 */
+	split = cell != &root_cell && cell_splits_l3(cell);
+	if (split && cdp_supported && !cdp_enabled) {
+		if (cell->arch.cos > (u32)get_cos_max(true))
+			return trace_error(-EBUSY);
+		for_each_cell(other)
+			if (other->arch.cos > (u32)get_cos_max(true))
+				return trace_error(-EBUSY);
+		set_cdp(true);
+	}
 
-		cell->arch.cat_mask =
-			BIT_MASK(cache->start + cache->size - 1, cache->start);
+	cache = jailhouse_cell_cache_regions(cell->config);
+	for (n = 0; n < cell->config->num_cache_regions; n++, cache++) {
+		regions = region_partitions(cache->type);
+		if (regions == 0 || (regions & owned) != 0)
+			goto err_release;
+
+		for (p = 0; p < CAT_NUM_PARTITIONS; p++) {
+			if (!(regions & (1 << p)))
+				continue;
+
+			/* ignore levels the CPU cannot partition */
+			if (!partitions[p].supported) {
+				regions &= ~(1 << p);
+				continue;
+			}
+			if (cache->size == 0 ||
+			    (cache->start + cache->size - 1) >
+			    partitions[p].cbm_max)
+				goto err_release;
+
+			cell->arch.cat_masks[p] =
+				BIT_MASK(cache->start + cache->size - 1,
+					 cache->start);
+		}
+		owned |= regions;
+
+		if (cell == &root_cell ||
+		    cache->flags & JAILHOUSE_CACHE_ROOTSHARED)
+			continue;
+
+		for (p = 0; p < CAT_NUM_PARTITIONS; p++) {
+			mask = cell->arch.cat_masks[p];
+			if (!(regions & (1 << p)))
+				continue;
+			if (!shrink_root_cell(cell, p, mask, &root_updated))
+				goto err_release;
+		}
+	}
 
-		if (cell != &root_cell &&
-		    !(cache->flags & JAILHOUSE_CACHE_ROOTSHARED) &&
-		    (root_cell.arch.cat_mask & cell->arch.cat_mask) != 0)
-			if (!shrink_root_cell_mask(cell->arch.cat_mask))
-				return trace_error(-EINVAL);
+	/* a cell without any usable region or bandwidth share needs no COS */
+	if (!owned && cell->config->mem_bandwidth == 0)
+		cell->arch.cos = CAT_ROOT_COS;
 
-		cat_update_cell(cell);
-	} else {
+	for (p = 0; p < CAT_NUM_PARTITIONS; p++) {
+		if (!partitions[p].supported || owned & (1 << p))
+			continue;
 		/*
 		 * The root cell always occupies COS0, using the whole cache if
-		 * no restriction is specified. Cells without own cache regions
-		 * share these settings.
+		 * no restriction is specified. Cells share its settings for
+		 * all partitions they do not define on their own.
 		 */
-		cell->arch.cat_mask = (cell == &root_cell) ?
-			BIT_MASK(cbm_max, 0) : root_cell.arch.cat_mask;
+		if (cell == &root_cell) {
+			cell->arch.cat_masks[p] =
+				BIT_MASK(partitions[p].cbm_max, 0);
+		} else {
+			cell->arch.cat_masks[p] = root_cell.arch.cat_masks[p];
+			if (cell->arch.cos != CAT_ROOT_COS)
+				cell->arch.cat_inherited |= 1 << p;
+		}
 	}
 
-	printk("CAT: Using COS %d with bitmask %08llx for cell %s\n",
-	       cell->arch.cos, cell->arch.cat_mask, cell->config->name);
+	if (split)
+		cdp_cells++;
+
+	if (root_updated)
+		update_root_cell();
+	if (owned || cell->arch.cos != CAT_ROOT_COS)
+		cat_update_cell(cell);
+
+	for (p = 0; p < CAT_NUM_PARTITIONS; p++)
+		if (partitions[p].supported)
+			printk("CAT: Using COS %d with %s bitmask %08llx for "
+			       "cell %s\n", cell->arch.cos, partitions[p].name,
+			       cell->arch.cat_masks[p], cell->config->name);
 
 	return 0;
+
+err_release:
+	if (root_updated)
+		release_cell_masks(cell, owned);
+	if (split && cdp_enabled && cdp_cells == 0 && !cdp_root_enabled)
+		set_cdp(false);
+	if (root_updated)
+		update_root_cell();
+	cell->arch.cos = CAT_ROOT_COS;
+	return trace_error(-EINVAL);
 }
 
 static void cat_cell_exit(struct cell *cell)
 {
 	/*
-	 * Only release the mask of cells with an own partition.
+	 * Only release the masks of cells with an own partition.
 	 * cos is also CAT_ROOT_COS if CAT is unsupported.
 	 */
 	if (cell->arch.cos == CAT_ROOT_COS)
 		return;
 
-	/*
-	 * Queue bits of released mask for returning to root that were in the
-	 * original root mask as well.
-	 */
-	freed_mask |= cell->arch.cat_mask & orig_root_mask;
+	/* also moves the CPUs handed back to the root cell to its COS */
+	release_cell_masks(cell, ~cell->arch.cat_inherited);
+	if (cell_splits_l3(cell) && --cdp_cells == 0 && !cdp_root_enabled)
+		set_cdp(false);
+	update_root_cell();
+}
 
-	if (merge_freed_mask_to_root()) {
-		printk("CAT: Extended root cell bitmask to %08llx\n",
-		       root_cell.arch.cat_mask);
-		cat_update_cell(&root_cell);
+static int init_l2_domains(void)
+{
+	unsigned int cpu;
+	u32 l2_cache_id;
+
+	l2_domains = page_alloc(&mem_pool,
+				PAGES(hypervisor_header.max_cpus *
+				      sizeof(struct l2_domain)));
+	if (!l2_domains)
+		return -ENOMEM;
+
+	for_each_cpu(cpu, root_cell.cpu_set) {
+		l2_cache_id = public_per_cpu(cpu)->l2_cache_id;
+		if (get_l2_domain(l2_cache_id))
+			continue;
+
+		l2_domains[num_l2_domains].id = l2_cache_id;
+		l2_domains[num_l2_domains].root_mask =
+			root_cell.arch.cat_masks[CAT_L2];
+		num_l2_domains++;
 	}
+
+	/* make the other CPUs pick up the mask of their L2 */
+	cat_update_cell(&root_cell);
+
+	return 0;
 }
 
 static int cat_init(void)
 {
+	unsigned int p, resources;
 	int err;
 
-	if (cpuid_ebx(7, 0) & X86_FEATURE_CAT &&
-	    cpuid_ebx(0x10, 0) & (1 << CAT_RESID_L3)) {
-		cbm_max = cpuid_eax(0x10, CAT_RESID_L3) & CAT_CBM_LEN_MASK;
-		cos_max = cpuid_edx(0x10, CAT_RESID_L3) & CAT_COS_MAX_MASK;
+	if (cpuid_ebx(7, 0) & X86_FEATURE_CAT) {
+		resources = cpuid_ebx(0x10, 0);
+
+		if (resources & (1 << CAT_RESID_L3)) {
+			partitions[CAT_L3_DATA].supported = true;
+			partitions[CAT_L3_DATA].cbm_max =
+				cpuid_eax(0x10, CAT_RESID_L3) &
+				CAT_CBM_LEN_MASK;
+			partitions[CAT_L3_CODE].cbm_max =
+				partitions[CAT_L3_DATA].cbm_max;
+			l3_cos_max = cpuid_edx(0x10, CAT_RESID_L3) &
+				CAT_COS_MAX_MASK;
+			cdp_supported = cpuid_ecx(0x10, CAT_RESID_L3) &
+				CAT_CDP_SUPPORTED;
+
+			/*
+			 * CDP stays on if the root cell enabled it before,
+			 * e.g. via Linux resctrl. Otherwise, it is enabled
+			 * while non-root cells need it.
+			 */
+			if (cdp_supported &&
+			    read_msr(MSR_IA32_L3_QOS_CFG) &
+			    L3_QOS_CFG_CDP_ENABLE) {
+				cdp_enabled = true;
+				cdp_root_enabled = true;
+				partitions[CAT_L3_DATA].name = "L3 data";
+				partitions[CAT_L3_CODE].supported = true;
+			}
+		}
+
+		if (resources & (1 << CAT_RESID_L2)) {
+			partitions[CAT_L2].supported = true;
+			partitions[CAT_L2].cbm_max =
+				cpuid_eax(0x10, CAT_RESID_L2) &
+				CAT_CBM_LEN_MASK;
+			l2_cos_max = cpuid_edx(0x10, CAT_RESID_L2) &
+				CAT_COS_MAX_MASK;
+		}
+
+		cos_max = get_cos_max(cdp_enabled);
+
+		/* MBA alone still needs COS assignments */
+		if (resources & (1 << CAT_RESID_MBA) && cos_max < 0)
+			cos_max = cpuid_edx(0x10, CAT_RESID_MBA) &
+				CAT_COS_MAX_MASK;
 	}
 
 	err = cat_cell_init(&root_cell);
-	orig_root_mask = root_cell.arch.cat_mask;
+	if (err)
+		return err;
+
+	for (p = 0; p < CAT_NUM_PARTITIONS; p++)
+		partitions[p].orig_root_mask = root_cell.arch.cat_masks[p];
 
-	return err;
+	if (partitions[CAT_L2].supported)
+		return init_l2_domains();
+
+	return 0;
 }
 
 DEFINE_UNIT_SHUTDOWN_STUB(cat);
@@ -0,0 +1,349 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/control.h>
+#include <jailhouse/printk.h>
+#include <jailhouse/string.h>
+#include <jailhouse/unit.h>
+#include <jailhouse/utils.h>
+#include <asm/apic.h>
+#include <asm/cmt.h>
+
+#include <jailhouse/cell-config.h>
+#include <jailhouse/hypercall.h>
+
+#define CMT_ROOT_RMID		0
+
+#define QM_EVT_LLC_OCCUPANCY	1
+#define QM_EVT_MBM_TOTAL	2
+#define QM_EVT_MBM_LOCAL	3
+
+struct cmt_counters {
+	/** Raw MBM counter values were read before, per enum cmt_mbm_event. */
+	bool mbm_valid[CMT_NUM_MBM_EVENTS];
+	/** Last raw MBM counter values per enum cmt_mbm_event. */
+	u64 mbm_raw[CMT_NUM_MBM_EVENTS];
+	/** Accumulated memory traffic in bytes per enum cmt_mbm_event. */
+	u64 mbm_bytes[CMT_NUM_MBM_EVENTS];
+	/** LLC occupancy in bytes at the last sample. */
+	u64 llc_occupancy;
+};
+
+static u32 events;
+static u32 rmid_max;
+/* bytes per counter unit */
+static u64 upscaling_factor;
+static unsigned int counter_width;
+
+/* IDs of the L3 caches, see public_per_cpu::l3_cache_id */
+static u32 domain_ids[CMT_MAX_DOMAINS];
+static unsigned int num_domains;
+/* counters per L3 domain and RMID */
+static struct cmt_counters *counters;
+/* RMIDs below this limit have been assigned to cells */
+static u32 rmid_limit;
+
+/* protects the counters and serializes their sampling */
+static spinlock_t cmt_lock;
+
+static const struct {
+	u32 feature;
+	u32 event_id;
+} mbm_events[CMT_NUM_MBM_EVENTS] = {
+	[CMT_MBM_TOTAL] = { CMT_EVT_MBM_TOTAL, QM_EVT_MBM_TOTAL },
+	[CMT_MBM_LOCAL] = { CMT_EVT_MBM_LOCAL, QM_EVT_MBM_LOCAL },
+};
+
+void cmt_update(void)
+{
+	struct cell *cell = this_cell();
+
+	write_msr(MSR_IA32_PQR_ASSOC,
+		  (u64)cell->arch.cos << PQR_ASSOC_COS_SHIFT | cell->arch.rmid);
+}
+
+/* root cell has to be stopped */
+static void cmt_update_cell(struct cell *cell)
+{
+	unsigned int cpu;
+
+	for_each_cpu(cpu, cell->cpu_set)
+		if (cpu == this_cpu_id())
+			cmt_update();
+		else
+			public_per_cpu(cpu)->update_cmt = true;
+}
+
+/*
+ * Counters are maintained per L3 domain, i.e. this returns the value of the
+ * domain the calling CPU belongs to.
+ */
+static int read_counter(u32 rmid, u32 event_id, u64 *value)
+{
+	write_msr(MSR_IA32_QM_EVTSEL,
+		  (u64)rmid << QM_EVTSEL_RMID_SHIFT | event_id);
+	*value = read_msr(MSR_IA32_QM_CTR);
+
+	if (*value & (QM_CTR_ERROR | QM_CTR_UNAVAILABLE))
+		return -EIO;
+	return 0;
+}
+
+static struct cmt_counters *rmid_counters(unsigned int domain, u32 rmid)
+{
+	return &counters[domain * (rmid_max + 1) + rmid];
+}
+
+static int domain_index(u32 l3_cache_id)
+{
+	unsigned int domain;
+
+	for (domain = 0; domain < num_domains; domain++)
+		if (domain_ids[domain] == l3_cache_id)
+			return domain;
+
+	return -1;
+}
+
+/*
+ * Sample the counters of all assigned RMIDs in the L3 domain of the calling
+ * CPU. Sampling only happens on queries. Traffic that passes between two
+ * samples while a hardware counter wraps around more than once is lost.
+ */
+void cmt_sample(void)
+{
+	int domain = domain_index(this_cpu_public()->l3_cache_id);
+	struct cmt_counters *ctrs;
+	enum cmt_mbm_event event;
+	u32 rmid;
+	u64 raw;
+
+	if (domain < 0)
+		return;
+
+	spin_lock(&cmt_lock);
+	for (rmid = 0; rmid < rmid_limit; rmid++) {
+		ctrs = rmid_counters(domain, rmid);
+
+		if (events & CMT_EVT_LLC_OCCUPANCY &&
+		    read_counter(rmid, QM_EVT_LLC_OCCUPANCY, &raw) == 0)
+			ctrs->llc_occupancy = raw * upscaling_factor;
+
+		for (event = 0; event < CMT_NUM_MBM_EVENTS; event++) {
+			if (!(events & mbm_events[event].feature) ||
+			    read_counter(rmid, mbm_events[event].event_id,
+					 &raw) != 0)
+				continue;
+
+			if (ctrs->mbm_valid[event])
+				ctrs->mbm_bytes[event] +=
+					((raw - ctrs->mbm_raw[event]) &
+					 BIT_MASK(counter_width - 1, 0)) *
+					upscaling_factor;
+			ctrs->mbm_raw[event] = raw;
+			ctrs->mbm_valid[event] = true;
+		}
+	}
+	spin_unlock(&cmt_lock);
+}
+
+/*
+ * Find a root cell CPU attached to the given L3 domain. CPUs of other cells
+ * are never disturbed for sampling.
+ */
+static int domain_cpu(unsigned int domain)
+{
+	unsigned int cpu;
+
+	for_each_cpu(cpu, root_cell.cpu_set)
+		if (public_per_cpu(cpu)->l3_cache_id == domain_ids[domain])
+			return cpu;
+
+	return -1;
+}
+
+/*
+ * Sample the domain of the calling root cell CPU directly and kick a root cell
+ * CPU in each other domain to do the same. The results of remote domains are
+ * not waited for, they are reported by the next query. Domains without root
+ * cell CPUs keep their last sample.
+ */
+static void sample_all_domains(void)
+{
+	int local = domain_index(this_cpu_public()->l3_cache_id);
+	struct public_per_cpu *target;
+	unsigned int domain;
+	bool kick;
+	int cpu;
+
+	cmt_sample();
+
+	for (domain = 0; domain < num_domains; domain++) {
+		cpu = domain_cpu(domain);
+		if ((int)domain == local || cpu < 0)
+			continue;
+
+		target = public_per_cpu(cpu);
+		spin_lock(&target->control_lock);
+		kick = !target->sample_cmt;
+		target->sample_cmt = true;
+		spin_unlock(&target->control_lock);
+
+		if (kick)
+			apic_send_nmi_ipi(target);
+	}
+}
+
+int cmt_get_info(struct cell *cell, unsigned long type)
+{
+	enum cmt_mbm_event event = CMT_MBM_TOTAL;
+	struct cmt_counters *ctrs;
+	bool occupancy = false;
+	unsigned int domain;
+	u64 value = 0;
+
+	switch (type) {
+	case JAILHOUSE_CPU_INFO_LLC_OCCUPANCY:
+		if (!(events & CMT_EVT_LLC_OCCUPANCY))
+			return -EINVAL;
+		occupancy = true;
+		break;
+	case JAILHOUSE_CPU_INFO_MBM_TOTAL:
+		event = CMT_MBM_TOTAL;
+		break;
+	case JAILHOUSE_CPU_INFO_MBM_LOCAL:
+		event = CMT_MBM_LOCAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (!occupancy && !(events & mbm_events[event].feature))
+		return -EINVAL;
+
+	sample_all_domains();
+
+	spin_lock(&cmt_lock);
+	for (domain = 0; domain < num_domains; domain++) {
+		ctrs = rmid_counters(domain, cell->arch.rmid);
+		value += occupancy ? ctrs->llc_occupancy :
+			ctrs->mbm_bytes[event];
+	}
+	spin_unlock(&cmt_lock);
+
+	if (occupancy)
+		/* report in KiB */
+		return (value >> 10) & BIT_MASK(30, 0);
+	/* report in MiB, wrapping like the CPU statistics */
+	return (value >> 20) & BIT_MASK(30, 0);
+}
+
+static u32 get_free_rmid(void)
+{
+	struct cell *cell;
+	u32 rmid = 0;
+
+retry:
+	for_each_cell(cell)
+		if (cell->arch.rmid == rmid) {
+			rmid++;
+			goto retry;
+		}
+
+	return rmid;
+}
+
+static int cmt_cell_init(struct cell *cell)
+{
+	unsigned int domain;
+
+	cell->arch.rmid = CMT_ROOT_RMID;
+
+	if (events == 0)
+		return 0;
+
+	if (cell != &root_cell) {
+		cell->arch.rmid = get_free_rmid();
+		/* monitoring is not worth failing the cell creation */
+		if (cell->arch.rmid > rmid_max) {
+			printk("CMT: No free RMID, cell %s shares the one of "
+			       "the root cell\n", cell->config->name);
+			cell->arch.rmid = CMT_ROOT_RMID;
+		}
+	}
+
+	/* a cell sharing the root cell's RMID also shares its counters */
+	if (cell == &root_cell || cell->arch.rmid != CMT_ROOT_RMID) {
+		spin_lock(&cmt_lock);
+		for (domain = 0; domain < num_domains; domain++)
+			memset(rmid_counters(domain, cell->arch.rmid), 0,
+			       sizeof(struct cmt_counters));
+		if (cell->arch.rmid >= rmid_limit)
+			rmid_limit = cell->arch.rmid + 1;
+		spin_unlock(&cmt_lock);
+	}
+
+	cmt_update_cell(cell);
+
+	printk("CMT: Using RMID %d for cell %s\n", cell->arch.rmid,
+	       cell->config->name);
+
+	return 0;
+}
+
+static void cmt_cell_exit(struct cell *cell)
+{
+	/* move the CPUs handed back to the root cell to its RMID */
+	if (cell->arch.rmid != CMT_ROOT_RMID)
+		cmt_update_cell(&root_cell);
+}
+
+static int cmt_init(void)
+{
+	unsigned int cpu;
+	u32 l3_cache_id;
+
+	if (!(cpuid_ebx(7, 0) & X86_FEATURE_PQM) ||
+	    !(cpuid_edx(0xf, 0) & (1 << CMT_RESID_L3)))
+		return 0;
+
+	events = cpuid_edx(0xf, CMT_RESID_L3) &
+		(CMT_EVT_LLC_OCCUPANCY | CMT_EVT_MBM_TOTAL | CMT_EVT_MBM_LOCAL);
+	rmid_max = cpuid_ecx(0xf, CMT_RESID_L3);
+	upscaling_factor = cpuid_ebx(0xf, CMT_RESID_L3);
+	counter_width = CMT_CTR_WIDTH_BASE +
+		(cpuid_eax(0xf, CMT_RESID_L3) & CMT_CTR_WIDTH_MASK);
+
+	for_each_cpu(cpu, root_cell.cpu_set) {
+		l3_cache_id = public_per_cpu(cpu)->l3_cache_id;
+		if (domain_index(l3_cache_id) >= 0)
+			continue;
+		if (num_domains == CMT_MAX_DOMAINS) {
+			printk("CMT: Too many L3 caches, not monitoring the "
+			       "one of CPU %d\n", cpu);
+			continue;
+		}
+		domain_ids[num_domains++] = l3_cache_id;
+	}
+
+	counters = page_alloc(&mem_pool,
+			      PAGES(num_domains * (rmid_max + 1) *
+				    sizeof(struct cmt_counters)));
+	if (!counters)
+		return -ENOMEM;
+
+	return cmt_cell_init(&root_cell);
+}
+
+DEFINE_UNIT_SHUTDOWN_STUB(cmt);
+DEFINE_UNIT_MMIO_COUNT_REGIONS_STUB(cmt);
+DEFINE_UNIT(cmt, "Cache and Memory Bandwidth Monitoring");
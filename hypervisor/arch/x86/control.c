@@ -15,6 +15,8 @@
 #include <jailhouse/processor.h>
 #include <asm/apic.h>
 #include <asm/cat.h>
+#include <asm/cmt.h>
+#include <asm/mba.h>
 #include <asm/control.h>
 #include <asm/ioapic.h>
 #include <asm/iommu.h>
@@ -38,43 +40,79 @@ int arch_cell_create(struct cell *cell)
 	if (err)
 		return err;
 
+	/*
+	 * The root table page of a new cell may have served a previously
+	 * destroyed one, so make sure no translations tagged with it survive.
+	 */
+	cell->arch.tlb_flush_pending = true;
+
 	return 0;
 }
 
+/*
+ * Mark the cell's TLBs for flushing if a memory map update since the given
+ * invalidation count removed or replaced translations.
+ */
+static void note_tlb_invalidations(struct cell *cell,
+				   unsigned long invalidations)
+{
+	if (paging_get_guest_invalidations() != invalidations)
+		cell->arch.tlb_flush_pending = true;
+}
+
 int arch_map_memory_region(struct cell *cell,
 			   const struct jailhouse_memory *mem)
 {
+	unsigned long invalidations = paging_get_guest_invalidations();
 	int err;
 
 	err = vcpu_map_memory_region(cell, mem);
 	if (err)
-		return err;
+		goto out;
 
 	err = iommu_map_memory_region(cell, mem);
 	if (err)
 		vcpu_unmap_memory_region(cell, mem);
+	else if (mem->flags & JAILHOUSE_MEM_DMA &&
+		 paging_get_guest_invalidations() != invalidations)
+		/* e.g. coalesced page tables, not tracked by range */
+		iommu_queue_flush_all(cell);
+
+out:
+	note_tlb_invalidations(cell, invalidations);
 	return err;
 }
 
 int arch_unmap_memory_region(struct cell *cell,
 			     const struct jailhouse_memory *mem)
 {
+	unsigned long invalidations = paging_get_guest_invalidations();
 	int err;
 
 	err = iommu_unmap_memory_region(cell, mem);
-	if (err)
-		return err;
+	if (!err)
+		err = vcpu_unmap_memory_region(cell, mem);
 
-	return vcpu_unmap_memory_region(cell, mem);
+	note_tlb_invalidations(cell, invalidations);
+	return err;
 }
 
 void arch_flush_cell_vcpu_caches(struct cell *cell)
 {
 	unsigned int cpu;
 
+	/*
+	 * Memory map updates that only filled holes leave nothing stale
+	 * behind, so the CPUs can keep their warm TLBs.
+	 */
+	if (!cell->arch.tlb_flush_pending)
+		return;
+	cell->arch.tlb_flush_pending = false;
+
 	for_each_cpu(cpu, cell->cpu_set)
 		if (cpu == this_cpu_id()) {
 			vcpu_tlb_flush();
+			x86_mmio_invalidate_decode_cache();
 		} else {
 			public_per_cpu(cpu)->flush_vcpu_caches = true;
 			apic_send_nmi_ipi(public_per_cpu(cpu));
@@ -108,6 +146,16 @@ void arch_config_commit(struct cell *cell_added_removed)
 	ioapic_config_commit(cell_added_removed);
 }
 
+int __attribute__((weak)) cmt_get_info(struct cell *cell, unsigned long type)
+{
+	return -EINVAL;
+}
+
+int arch_cpu_get_info(unsigned int cpu_id, unsigned long type)
+{
+	return cmt_get_info(public_per_cpu(cpu_id)->cell, type);
+}
+
 void arch_prepare_shutdown(void)
 {
 	ioapic_prepare_handover();
@@ -177,11 +225,46 @@ void __attribute__((weak)) cat_update(void)
 {
 }
 
+void __attribute__((weak)) mba_update(void)
+{
+}
+
+void __attribute__((weak)) cmt_update(void)
+{
+}
+
+void __attribute__((weak)) cmt_sample(void)
+{
+}
+
+/*
+ * Lockless pre-check of the requests x86_check_events processes. Requesters
+ * update these fields under control_lock before sending an event to the CPU,
+ * so a request missed here is picked up on the exit caused by that event.
+ */
+static bool x86_events_pending(struct public_per_cpu *cpu_public)
+{
+	return cpu_public->suspend_cpu || cpu_public->init_signaled ||
+		cpu_public->sipi_vector >= 0 || cpu_public->wait_for_sipi ||
+		cpu_public->flush_vcpu_caches || cpu_public->update_cat ||
+		cpu_public->update_mba || cpu_public->update_cmt ||
+		cpu_public->sample_cmt;
+}
+
 void x86_check_events(void)
 {
 	struct public_per_cpu *cpu_public = this_cpu_public();
 	int sipi_vector = -1;
 
+	/*
+	 * Spurious checks, e.g. on preemption timer exits without a pending
+	 * request, skip the lock round-trip.
+	 */
+	if (!x86_events_pending(cpu_public)) {
+		iommu_check_pending_faults();
+		return;
+	}
+
 	spin_lock(&cpu_public->control_lock);
 
 	while (cpu_public->suspend_cpu) {
@@ -210,6 +293,7 @@ void x86_check_events(void)
 	if (cpu_public->flush_vcpu_caches) {
 		cpu_public->flush_vcpu_caches = false;
 		vcpu_tlb_flush();
+		x86_mmio_invalidate_decode_cache();
 	}
 
 	if (cpu_public->update_cat) {
@@ -217,6 +301,21 @@ void x86_check_events(void)
 		cat_update();
 	}
 
+	if (cpu_public->update_mba) {
+		cpu_public->update_mba = false;
+		mba_update();
+	}
+
+	if (cpu_public->update_cmt) {
+		cpu_public->update_cmt = false;
+		cmt_update();
+	}
+
+	if (cpu_public->sample_cmt) {
+		cmt_sample();
+		cpu_public->sample_cmt = false;
+	}
+
 	spin_unlock(&cpu_public->control_lock);
 
 	/* wait_for_sipi is only modified on this CPU, so checking outside of
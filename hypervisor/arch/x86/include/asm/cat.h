@@ -10,4 +10,22 @@
  * the COPYING file in the top-level directory.
  */
 
+#ifndef _JAILHOUSE_ASM_CAT_H
+#define _JAILHOUSE_ASM_CAT_H
+
+/** Cache partitions that can be allocated per cell. */
+enum cat_partition {
+	/** L3 data, or the whole L3 if CDP is not enabled. */
+	CAT_L3_DATA,
+	/** L3 code, only used if CDP is enabled. */
+	CAT_L3_CODE,
+	/** L2 of the cell's CPUs. */
+	CAT_L2,
+	CAT_NUM_PARTITIONS
+};
+
+#define CAT_ROOT_COS	0
+
 void cat_update(void);
+
+#endif /* !_JAILHOUSE_ASM_CAT_H */
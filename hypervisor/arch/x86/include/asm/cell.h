@@ -16,19 +16,40 @@
 #define _JAILHOUSE_ASM_CELL_H
 
 #include <jailhouse/paging.h>
+#include <asm/cat.h>
 
 struct cell_ioapic;
 
+#define IOMMU_FLUSH_MAX_RANGES	8
+
+/** Guest-physical ranges with possibly stale IOMMU translations. */
+struct iommu_flush_queue {
+	/** True if the whole domain has to be flushed. */
+	bool all;
+	/** Number of valid entries in ranges. */
+	unsigned int num_ranges;
+	struct {
+		u64 start;
+		u64 size;
+	} ranges[IOMMU_FLUSH_MAX_RANGES];
+};
+
 /** x86-specific cell states. */
 struct arch_cell {
 	/** Buffer for the EPT/NPT root-level page table. */
 	u8 __attribute__((aligned(PAGE_SIZE))) root_table_page[PAGE_SIZE];
 
 	bool pio_i8042_allowed;
+	/** True if the TLBs of the cell's CPUs may hold stale guest-physical
+	 * translations that have to be flushed on the next config commit. */
+	bool tlb_flush_pending;
 
 	/* Intel: PIO access bitmap.
 	 * AMD: I/O Permissions Map. */
 	u8 *io_bitmap;
+	/** Private MSR bitmap (Intel) or MSR Permissions Map (AMD) if the cell
+	 * has an MSR whitelist, NULL if it uses the shared one. */
+	u8 *msr_bitmap;
 	union {
 		struct {
 			/** Paging structures used for cell CPUs. */
@@ -44,11 +65,15 @@ struct arch_cell {
 		struct {
 			/** Paging structures used for DMA requests. */
 			struct paging_structures pg_structs;
+			/** True if pg_structs refers to the cell's EPT. */
+			bool ept_shared;
 			/** True if interrupt remapping support is emulated for this
 			 * cell. */
 			bool ir_emulation;
 		} vtd; /**< Intel VT-d specific fields. */
 	};
+	/** IOTLB invalidations pending for the next config commit. */
+	struct iommu_flush_queue iommu_flush;
 
 	/** Shadow value of PCI config space address port register. */
 	u32 pci_addr_port_val;
@@ -60,8 +85,16 @@ struct arch_cell {
 
 	/** Class Of Service for cache allocation (Intel only). */
 	u32 cos;
-	/** Allocated L3 cache region (Intel only). */
-	u64 cat_mask;
+	/** Allocated cache regions per enum cat_partition (Intel only). */
+	u64 cat_masks[CAT_NUM_PARTITIONS];
+	/** Partitions without own region that follow the root cell's mask. */
+	unsigned int cat_inherited;
+	/** Share of the memory bandwidth in percent (Intel only). */
+	unsigned int mba_share;
+	/** Throttling delay of the cell's COS (Intel only). */
+	u32 mba_delay;
+	/** Resource Monitoring ID (Intel only). */
+	u32 rmid;
 };
 
 #endif /* !_JAILHOUSE_ASM_CELL_H */
@@ -0,0 +1,36 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#ifndef _JAILHOUSE_ASM_CMT_H
+#define _JAILHOUSE_ASM_CMT_H
+
+#include <jailhouse/types.h>
+
+/** Maximum number of L3 caches whose monitoring counters are tracked. */
+#define CMT_MAX_DOMAINS		8
+
+/** Memory bandwidth monitoring events tracked per cell. */
+enum cmt_mbm_event {
+	/** All traffic to memory. */
+	CMT_MBM_TOTAL,
+	/** Traffic to memory of the local NUMA node. */
+	CMT_MBM_LOCAL,
+	CMT_NUM_MBM_EVENTS
+};
+
+struct cell;
+
+void cmt_update(void);
+void cmt_sample(void);
+int cmt_get_info(struct cell *cell, unsigned long type);
+
+#endif /* !_JAILHOUSE_ASM_CMT_H */
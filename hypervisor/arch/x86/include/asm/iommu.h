@@ -41,6 +41,14 @@ int iommu_map_interrupt(struct cell *cell,
 			unsigned int vector,
 			struct apic_irq_message irq_msg);
 
+void iommu_queue_flush(struct cell *cell, u64 start, u64 size);
+void iommu_queue_flush_all(struct cell *cell);
+bool iommu_flush_queued_blocks(struct cell *cell, unsigned int max_order,
+			       void (*flush_block)(void *arg, u64 addr,
+						   unsigned int order),
+			       void *arg);
+void iommu_reset_flush_queue(struct cell *cell);
+
 void iommu_config_commit(struct cell *cell_added_removed);
 
 void iommu_prepare_shutdown(void);
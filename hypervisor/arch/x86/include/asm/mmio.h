@@ -10,6 +10,9 @@
  * the COPYING file in the top-level directory.
  */
 
+#ifndef _JAILHOUSE_ASM_MMIO_H
+#define _JAILHOUSE_ASM_MMIO_H
+
 #include <jailhouse/paging.h>
 
 /**
@@ -37,15 +40,58 @@ struct mmio_instruction {
 	unsigned long reg_preserve_mask;
 };
 
+/** Maximum length of an x86 instruction. */
+#define X86_MAX_INST_LEN		15
+
+/** Number of entries in the per-CPU MMIO instruction decode cache. */
+#define MMIO_DECODE_CACHE_ENTRIES	8
+
+/** Decoded MMIO instruction, cached per guest address space and RIP. */
+struct mmio_decode_entry {
+	/** Guest paging mode the instruction was fetched under. */
+	const struct paging *root_paging;
+	/** Guest-physical address of the guest root page table. */
+	unsigned long root_table_gphys;
+	/** Guest RIP of the instruction. */
+	u64 rip;
+	/** CS attributes, defining default operand and address size. */
+	u16 cs_attr;
+	/** True if the instruction performs a write access. */
+	bool is_write;
+	/** Register providing mmio_instruction::out_val on writes, -1 if the
+	 * value is an immediate or the instruction reads. */
+	int out_reg;
+	/** Decoding result, mmio_instruction::inst_len is 0 for unused
+	 * entries. */
+	struct mmio_instruction inst;
+	/** Instruction bytes the entry was decoded from. */
+	u8 bytes[X86_MAX_INST_LEN];
+};
+
+/** Per-CPU cache of decoded MMIO instructions. */
+struct mmio_decode_cache {
+	struct mmio_decode_entry entries[MMIO_DECODE_CACHE_ENTRIES];
+};
+
 /**
  * Parse instruction causing an intercepted MMIO access on a cell CPU.
  * @param pg_structs	Currently active guest (cell) paging structures.
  * @param is_write	True if write access, false for read.
  *
+ * If the CPU provides the instruction bytes with the VM exit (AMD decode
+ * assists), instructions that were already decoded under the same guest
+ * paging structures, RIP and CS attributes are served from the per-CPU decode
+ * cache without decoding them again, provided that their bytes did not
+ * change.
+ *
  * @return MMIO instruction information. mmio_instruction::inst_len is 0 on
  * 	   invalid or unsupported access.
  */
 struct mmio_instruction
 x86_mmio_parse(const struct guest_paging_structures *pg_structs, bool is_write);
 
+void x86_mmio_invalidate_decode_cache(void);
+
 /** @} */
+
+#endif /* !_JAILHOUSE_ASM_MMIO_H */
@@ -54,11 +54,27 @@
 
 typedef unsigned long *pt_entry_t;
 
+/* Above this number of pages, reloading CR3 is cheaper than INVLPG. */
+#define TLB_FLUSH_CEILING	32
+
 static inline void arch_paging_flush_page_tlbs(unsigned long page_addr)
 {
 	asm volatile("invlpg (%0)" : : "r" (page_addr));
 }
 
+static inline void arch_paging_flush_tlbs(unsigned long start,
+					  unsigned long pages)
+{
+	/* The hypervisor does not use global pages, a CR3 reload drops all. */
+	if (pages > TLB_FLUSH_CEILING) {
+		write_cr3(read_cr3());
+		return;
+	}
+
+	for (; pages > 0; pages--, start += PAGE_SIZE)
+		arch_paging_flush_page_tlbs(start);
+}
+
 extern unsigned long cache_line_size;
 
 static inline void arch_paging_flush_cpu_caches(void *addr, long size)
@@ -13,6 +13,7 @@
  */
 
 #include <jailhouse/cell.h>
+#include <asm/mmio.h>
 #include <asm/svm.h>
 #include <asm/vmx.h>
 
@@ -23,6 +24,12 @@
 #define ARCH_PUBLIC_PERCPU_FIELDS					\
 	/** Physical APIC ID. */					\
 	u32 apic_id;							\
+	/** ID of the L3 cache the CPU is attached to. CPUs sharing the	\
+	 *  cache have the same ID. */					\
+	u32 l3_cache_id;						\
+	/** ID of the L2 cache the CPU is attached to. CPUs sharing the	\
+	 *  cache have the same ID. */					\
+	u32 l2_cache_id;						\
 									\
 	/**								\
 	 * Lock protecting CPU state changes done for control tasks.	\
@@ -37,6 +44,9 @@
 	 * @li public_per_cpu::sipi_vector				\
 	 * @li public_per_cpu::flush_vcpu_caches			\
 	 * @li public_per_cpu::update_cat				\
+	 * @li public_per_cpu::update_mba				\
+	 * @li public_per_cpu::update_cmt				\
+	 * @li public_per_cpu::sample_cmt				\
 	 */								\
 	spinlock_t control_lock;					\
 									\
@@ -48,7 +58,16 @@
 	int sipi_vector;						\
 	/** Set to true for pending cache allocation updates (Intel	\
 	 *  only). */							\
-	bool update_cat;
+	bool update_cat;						\
+	/** Set to true for pending memory bandwidth allocation updates	\
+	 *  (Intel only). */						\
+	bool update_mba;						\
+	/** Set to true for pending resource monitoring updates (Intel	\
+	 *  only). */							\
+	bool update_cmt;						\
+	/** Set to true for requesting a sample of the resource		\
+	 *  monitoring counters of the CPU's L3 cache (Intel only). */	\
+	volatile bool sample_cmt;
 
 #define ARCH_PERCPU_FIELDS						\
 	/** Linux stack pointer, used for handover to hypervisor. */	\
@@ -79,10 +98,13 @@
 	/** Cached PDPTEs, used by VMX for PAE guest paging mode. */	\
 	unsigned long pdpte[4];						\
 									\
+	/** Recently decoded MMIO instructions. */			\
+	struct mmio_decode_cache mmio_decode_cache;			\
+									\
 	/* IOMMU request completion flags */				\
 	union {								\
 		volatile u32 vtd_iq_completed;				\
-		volatile u64 amd_iommu_sem;				\
+		volatile u64 amd_iommu_sem[JAILHOUSE_MAX_IOMMU_UNITS];	\
 	};								\
 									\
 	/** True when CPU is initialized by hypervisor. */		\
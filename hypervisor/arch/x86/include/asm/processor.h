@@ -28,8 +28,17 @@
 #define X86_FEATURE_OSXSAVE				(1 << 27)
 #define X86_FEATURE_HYPERVISOR				(1 << 31)
 
+/* leaf 0x04, EAX */
+#define CPUID_CACHE_TYPE_MASK				BIT_MASK(4, 0)
+#define CPUID_CACHE_LEVEL_SHIFT				5
+#define CPUID_CACHE_LEVEL_MASK				BIT_MASK(7, 5)
+#define CPUID_CACHE_SHARING_SHIFT			14
+#define CPUID_CACHE_SHARING_MASK			BIT_MASK(25, 14)
+
 /* leaf 0x07, subleaf 0, EBX */
+#define X86_FEATURE_ERMS				(1 << 9)
 #define X86_FEATURE_INVPCID				(1 << 10)
+#define X86_FEATURE_PQM					(1 << 12)
 #define X86_FEATURE_CAT					(1 << 15)
 
 /* leaf 0x07, subleaf 0, ECX */
@@ -47,6 +56,7 @@
 
 /* leaf 0x8000000a, EDX */
 #define X86_FEATURE_NP					(1 << 0)
+#define X86_FEATURE_NRIP_SAVE				(1 << 3)
 #define X86_FEATURE_FLUSH_BY_ASID			(1 << 6)
 #define X86_FEATURE_DECODE_ASSISTS			(1 << 7)
 #define X86_FEATURE_AVIC				(1 << 13)
@@ -97,8 +107,13 @@
 #define MSR_X2APIC_BASE					0x00000800
 #define MSR_X2APIC_ICR					0x00000830
 #define MSR_X2APIC_END					0x0000083f
+#define MSR_IA32_L3_QOS_CFG				0x00000c81
+#define MSR_IA32_QM_EVTSEL				0x00000c8d
+#define MSR_IA32_QM_CTR					0x00000c8e
 #define MSR_IA32_PQR_ASSOC				0x00000c8f
 #define MSR_IA32_L3_MASK_0				0x00000c90
+#define MSR_IA32_L2_MASK_0				0x00000d10
+#define MSR_IA32_MBA_THRTL_0				0x00000d50
 #define MSR_EFER					0xc0000080
 #define MSR_STAR					0xc0000081
 #define MSR_LSTAR					0xc0000082
@@ -123,10 +138,29 @@
 
 #define PQR_ASSOC_COS_SHIFT				32
 
+#define CMT_RESID_L3					1
+#define CMT_EVT_LLC_OCCUPANCY				(1 << 0)
+#define CMT_EVT_MBM_TOTAL				(1 << 1)
+#define CMT_EVT_MBM_LOCAL				(1 << 2)
+#define CMT_CTR_WIDTH_MASK				BIT_MASK(7, 0)
+#define CMT_CTR_WIDTH_BASE				24
+
+#define QM_EVTSEL_RMID_SHIFT				32
+#define QM_CTR_ERROR					(1UL << 63)
+#define QM_CTR_UNAVAILABLE				(1UL << 62)
+
 #define CAT_RESID_L3					1
+#define CAT_RESID_L2					2
+#define CAT_RESID_MBA					3
 
 #define CAT_CBM_LEN_MASK				BIT_MASK(4, 0)
 #define CAT_COS_MAX_MASK				BIT_MASK(15, 0)
+#define CAT_CDP_SUPPORTED				(1 << 2)
+
+#define L3_QOS_CFG_CDP_ENABLE				(1 << 0)
+
+#define MBA_MAX_DELAY_MASK				BIT_MASK(11, 0)
+#define MBA_LINEAR					(1 << 2)
 
 #define GDT_DESC_NULL					0
 #define GDT_DESC_CODE					1
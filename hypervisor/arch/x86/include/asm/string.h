@@ -0,0 +1,17 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2024
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#define ARCH_HAS_MEMCPY
+#define ARCH_HAS_MEMSET
+
+/** True if the CPU supports enhanced REP MOVSB/STOSB (ERMS). */
+extern bool enhanced_rep_movsb;
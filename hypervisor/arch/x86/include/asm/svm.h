@@ -35,6 +35,7 @@
 #define SVM_MSRPM_C001		2
 #define SVM_MSRPM_RESV		3
 
+#define SVM_TLB_FLUSH_NONE	0x00
 #define SVM_TLB_FLUSH_ALL	0x01
 #define SVM_TLB_FLUSH_GUEST	0x03
 
@@ -262,7 +263,8 @@ enum clean_bits {
 	CLEAN_BITS_SEG	= 1 << 8,
 	CLEAN_BITS_CR2	= 1 << 9,
 	CLEAN_BITS_LBR	= 1 << 10,
-	CLEAN_BITS_AVIC	= 1 << 11
+	CLEAN_BITS_AVIC	= 1 << 11,
+	CLEAN_BITS_ALL	= (1 << 12) - 1
 };
 
 typedef u64 vintr_t;
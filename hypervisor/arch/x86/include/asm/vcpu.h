@@ -81,10 +81,25 @@ const u8 *vcpu_map_inst(const struct guest_paging_structures *pg_structs,
 const u8 *vcpu_get_inst_bytes(const struct guest_paging_structures *pg_structs,
 			      unsigned long pc, unsigned int *size);
 
+/*
+ * Return the instruction bytes at the guest RIP that the CPU provided along
+ * with the current VM exit, or NULL if there are none. *size is set to the
+ * number of bytes available.
+ */
+const u8 *vcpu_get_exit_inst_bytes(unsigned int *size);
+
 void vcpu_skip_emulated_instruction(unsigned int inst_len);
 
 unsigned int vcpu_vendor_get_io_bitmap_pages(void);
 
+unsigned int vcpu_vendor_get_msr_bitmap_pages(void);
+
+/*
+ * Stop intercepting reads or writes of the given MSR in a cell's private MSR
+ * bitmap. MSRs the hypervisor needs to intercept stay intercepted.
+ */
+void vcpu_vendor_msr_allow_access(u8 *msr_bitmap, u32 msr, bool is_write);
+
 #define VCPU_CS_DPL_MASK	BIT_MASK(6, 5)
 #define VCPU_CS_L		(1 << 13)
 #define VCPU_CS_DB		(1 << 14)
@@ -13,6 +13,12 @@
 #include <jailhouse/control.h>
 #include <asm/iommu.h>
 
+/* ranges larger than this in total are flushed domain-wide */
+#define IOMMU_FLUSH_ALL_THRESHOLD	(1UL << 30)
+#define IOMMU_FLUSH_MAX_BLOCKS		32
+
+#define FLUSH_BLOCK_SIZE(order)		((u64)PAGE_SIZE << (order))
+
 unsigned int fault_reporting_cpu_id;
 
 unsigned int iommu_count_units(void)
@@ -38,3 +44,115 @@ struct public_per_cpu *iommu_select_fault_reporting_cpu(void)
 
 	return public_per_cpu(fault_reporting_cpu_id);
 }
+
+/**
+ * Records that IOMMU translations of a guest-physical range may be stale.
+ * @param cell		Cell owning the translations.
+ * @param start		Start of the range.
+ * @param size		Size of the range.
+ */
+void iommu_queue_flush(struct cell *cell, u64 start, u64 size)
+{
+	struct iommu_flush_queue *queue = &cell->arch.iommu_flush;
+	u64 total = size;
+	unsigned int n;
+
+	for (n = 0; n < queue->num_ranges; n++)
+		total += queue->ranges[n].size;
+
+	/* beyond that, refilling the IOTLBs is cheaper than the requests */
+	if (queue->num_ranges == IOMMU_FLUSH_MAX_RANGES ||
+	    total > IOMMU_FLUSH_ALL_THRESHOLD) {
+		queue->all = true;
+		return;
+	}
+
+	queue->ranges[queue->num_ranges].start = start & PAGE_MASK;
+	queue->ranges[queue->num_ranges].size =
+		PAGE_ALIGN(start + size) - (start & PAGE_MASK);
+	queue->num_ranges++;
+}
+
+/**
+ * Requests a flush of all IOMMU translations of a cell.
+ * @param cell		Cell owning the translations.
+ */
+void iommu_queue_flush_all(struct cell *cell)
+{
+	cell->arch.iommu_flush.all = true;
+}
+
+static unsigned int flush_block_order(u64 addr, u64 size,
+				      unsigned int max_order)
+{
+	unsigned int order = 0;
+
+	while (order < max_order && !(addr & FLUSH_BLOCK_SIZE(order)) &&
+	       FLUSH_BLOCK_SIZE(order + 1) <= size)
+		order++;
+
+	return order;
+}
+
+static unsigned int count_flush_blocks(struct iommu_flush_queue *queue,
+				       unsigned int max_order)
+{
+	unsigned int n, order, blocks = 0;
+	u64 addr, size;
+
+	for (n = 0; n < queue->num_ranges; n++)
+		for (addr = queue->ranges[n].start,
+		     size = queue->ranges[n].size; size > 0;
+		     addr += FLUSH_BLOCK_SIZE(order),
+		     size -= FLUSH_BLOCK_SIZE(order)) {
+			order = flush_block_order(addr, size, max_order);
+			blocks++;
+		}
+
+	return blocks;
+}
+
+/**
+ * Splits the queued ranges of a cell into naturally aligned blocks of
+ * 2^order pages for vendor-specific selective invalidations.
+ * @param cell		Cell owning the translations.
+ * @param max_order	Largest block order the IOMMU can invalidate at once.
+ * @param flush_block	Callback that queues the invalidation of a block.
+ * @param arg		Argument passed to @c flush_block.
+ *
+ * @return False if the whole domain has to be flushed instead.
+ */
+bool iommu_flush_queued_blocks(struct cell *cell, unsigned int max_order,
+			       void (*flush_block)(void *arg, u64 addr,
+						   unsigned int order),
+			       void *arg)
+{
+	struct iommu_flush_queue *queue = &cell->arch.iommu_flush;
+	unsigned int n, order;
+	u64 addr, size;
+
+	if (queue->all ||
+	    count_flush_blocks(queue, max_order) > IOMMU_FLUSH_MAX_BLOCKS)
+		return false;
+
+	for (n = 0; n < queue->num_ranges; n++)
+		for (addr = queue->ranges[n].start,
+		     size = queue->ranges[n].size; size > 0;
+		     addr += FLUSH_BLOCK_SIZE(order),
+		     size -= FLUSH_BLOCK_SIZE(order)) {
+			order = flush_block_order(addr, size, max_order);
+			flush_block(arg, addr, order);
+		}
+
+	return true;
+}
+
+/**
+ * Drops all queued IOMMU invalidations of a cell after they were performed.
+ * @param cell		Cell owning the translations.
+ */
+void iommu_reset_flush_queue(struct cell *cell)
+{
+	cell->arch.iommu_flush.all = false;
+	cell->arch.iommu_flush.num_ranges = 0;
+}
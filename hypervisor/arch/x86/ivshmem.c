@@ -20,6 +20,10 @@
 void arch_ivshmem_trigger_interrupt(struct ivshmem_endpoint *ive,
 				    unsigned int vector)
 {
+	/*
+	 * The target cell owns the APIC of the destination CPU, so this
+	 * physical IPI is delivered to the guest without a VM exit.
+	 */
 	if (ive->irq_cache.msg[vector].valid)
 		apic_send_irq(ive->irq_cache.msg[vector]);
 }
@@ -0,0 +1,55 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2024
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/string.h>
+
+/* Detected in arch_init_early, string operations work before as well. */
+bool enhanced_rep_movsb;
+
+void *memcpy(void *dest, const void *src, size_t n)
+{
+	unsigned long qwords;
+	void *d = dest;
+
+	/* Without ERMS, move the bulk as quadwords, only the tail bytewise. */
+	if (!enhanced_rep_movsb) {
+		qwords = n / 8;
+		n %= 8;
+		asm volatile("rep movsq"
+			: "+D" (d), "+S" (src), "+c" (qwords)
+			: : "memory");
+	}
+	asm volatile("rep movsb"
+		: "+D" (d), "+S" (src), "+c" (n)
+		: : "memory");
+	return dest;
+}
+
+void *memset(void *s, int c, size_t n)
+{
+	unsigned long qwords;
+	void *p = s;
+
+	if (!enhanced_rep_movsb) {
+		qwords = n / 8;
+		n %= 8;
+		asm volatile("rep stosq"
+			: "+D" (p), "+c" (qwords)
+			: "a" (0x0101010101010101UL * (u8)c)
+			: "memory");
+	}
+	asm volatile("rep stosb"
+		: "+D" (p), "+c" (n)
+		: "a" (c)
+		: "memory");
+	return s;
+}
@@ -0,0 +1,172 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/control.h>
+#include <jailhouse/printk.h>
+#include <jailhouse/unit.h>
+#include <jailhouse/utils.h>
+#include <asm/cat.h>
+#include <asm/mba.h>
+
+#include <jailhouse/cell-config.h>
+
+#define MBA_FULL_SHARE	100
+
+static bool mba_supported;
+static unsigned int mba_cos_max;
+/* smallest share that can be granted, also the step size of shares */
+static unsigned int granularity;
+/* sum of the shares of all non-root cells */
+static unsigned int claimed_share;
+static u32 orig_root_delay;
+
+void mba_update(void)
+{
+	struct cell *cell = this_cell();
+
+	write_msr(MSR_IA32_MBA_THRTL_0 + cell->arch.cos, cell->arch.mba_delay);
+}
+
+/* root cell has to be stopped */
+static void mba_update_cell(struct cell *cell)
+{
+	unsigned int cpu;
+
+	for_each_cpu(cpu, cell->cpu_set)
+		if (cpu == this_cpu_id())
+			mba_update();
+		else
+			public_per_cpu(cpu)->update_mba = true;
+}
+
+static void set_cell_share(struct cell *cell, unsigned int share)
+{
+	cell->arch.mba_share = share;
+	/* round down to the granularity, but never throttle beyond it */
+	cell->arch.mba_delay = MBA_FULL_SHARE -
+		MAX(share / granularity * granularity, granularity);
+}
+
+/*
+ * Shrink or extend the root cell's share so that it covers the bandwidth
+ * not claimed by other cells, limited by its own configuration. The root
+ * cell has to be stopped.
+ */
+static void update_root_cell_share(void)
+{
+	unsigned int share = root_cell.config->mem_bandwidth;
+
+	if (share == 0 || share > MBA_FULL_SHARE - claimed_share)
+		share = MBA_FULL_SHARE - claimed_share;
+	if (share == root_cell.arch.mba_share)
+		return;
+
+	set_cell_share(&root_cell, share);
+	printk("MBA: Set root cell bandwidth share to %u%%\n", share);
+
+	mba_update_cell(&root_cell);
+}
+
+static int mba_cell_init(struct cell *cell)
+{
+	unsigned int share = cell->config->mem_bandwidth;
+
+	cell->arch.mba_share = 0;
+	cell->arch.mba_delay = 0;
+
+	if (!mba_supported)
+		return 0;
+
+	if (share > MBA_FULL_SHARE)
+		return trace_error(-EINVAL);
+
+	if (cell == &root_cell) {
+		update_root_cell_share();
+		return 0;
+	}
+
+	/* a COS used for cache allocation only must not inherit throttling */
+	if (share == 0) {
+		if (cell->arch.cos != CAT_ROOT_COS)
+			mba_update_cell(cell);
+		return 0;
+	}
+
+	/* the COS was already assigned by the CAT unit */
+	if (cell->arch.cos == CAT_ROOT_COS)
+		return trace_error(-EINVAL);
+	if (cell->arch.cos > mba_cos_max)
+		return trace_error(-EBUSY);
+
+	if (share < granularity)
+		share = granularity;
+	/* the root cell must keep a minimal share */
+	if (claimed_share + share > MBA_FULL_SHARE - granularity)
+		return trace_error(-EBUSY);
+
+	claimed_share += share;
+	set_cell_share(cell, share);
+	update_root_cell_share();
+	mba_update_cell(cell);
+
+	printk("MBA: Using COS %d with bandwidth share %u%% for cell %s\n",
+	       cell->arch.cos, share, cell->config->name);
+
+	return 0;
+}
+
+static void mba_cell_exit(struct cell *cell)
+{
+	if (cell->arch.mba_share == 0 || cell == &root_cell)
+		return;
+
+	claimed_share -= cell->arch.mba_share;
+	cell->arch.mba_share = 0;
+	update_root_cell_share();
+}
+
+static int mba_init(void)
+{
+	unsigned int max_delay;
+
+	if (!(cpuid_ebx(7, 0) & X86_FEATURE_CAT) ||
+	    !(cpuid_ebx(0x10, 0) & (1 << CAT_RESID_MBA)))
+		return 0;
+
+	/* non-linear throttling values cannot be mapped to shares */
+	if (!(cpuid_ecx(0x10, CAT_RESID_MBA) & MBA_LINEAR)) {
+		printk("MBA: Ignoring non-linear throttling\n");
+		return 0;
+	}
+
+	/* CPUID reports the maximum throttling value minus one */
+	max_delay = (cpuid_eax(0x10, CAT_RESID_MBA) & MBA_MAX_DELAY_MASK) + 1;
+	if (max_delay >= MBA_FULL_SHARE)
+		return trace_error(-EIO);
+	granularity = MBA_FULL_SHARE - max_delay;
+	mba_cos_max = cpuid_edx(0x10, CAT_RESID_MBA) & CAT_COS_MAX_MASK;
+	mba_supported = true;
+	orig_root_delay = read_msr(MSR_IA32_MBA_THRTL_0 + CAT_ROOT_COS);
+
+	return mba_cell_init(&root_cell);
+}
+
+static void mba_shutdown(void)
+{
+	/* the throttling MSRs are shared by the package */
+	if (mba_supported)
+		write_msr(MSR_IA32_MBA_THRTL_0 + CAT_ROOT_COS,
+			  orig_root_delay);
+}
+
+DEFINE_UNIT_MMIO_COUNT_REGIONS_STUB(mba);
+DEFINE_UNIT(mba, "Memory Bandwidth Allocation");
@@ -15,10 +15,9 @@
 #include <jailhouse/mmio.h>
 #include <jailhouse/paging.h>
 #include <jailhouse/printk.h>
+#include <jailhouse/string.h>
 #include <asm/vcpu.h>
 
-#define X86_MAX_INST_LEN	15
-
 /*
  * There are a few instructions that can have 8-byte immediate values
  * on 64-bit mode, but they are not supported/expected here, so we are
@@ -105,8 +104,9 @@ static void parse_widths(struct parse_context *ctx,
 	}
 }
 
-struct mmio_instruction
-x86_mmio_parse(const struct guest_paging_structures *pg_structs, bool is_write)
+static struct mmio_instruction
+parse_instruction(const struct guest_paging_structures *pg_structs,
+		  bool is_write, int *out_reg)
 {
 	struct parse_context ctx = { .remaining = X86_MAX_INST_LEN,
 				     .count = 1 };
@@ -182,6 +182,7 @@ restart:
 	case X86_OP_MOV_AX_TO_MEM:
 		parse_widths(&ctx, &inst, true);
 		inst.out_val = guest_regs->by_index[15];
+		*out_reg = 15;
 		ctx.does_write = true;
 		goto final;
 	default:
@@ -278,8 +279,10 @@ restart:
 			inst.out_val = (s64)(s32)inst.out_val;
 	} else {
 		inst.inst_len += skip_len;
-		if (ctx.does_write)
+		if (ctx.does_write) {
 			inst.out_val = guest_regs->by_index[inst.in_reg_num];
+			*out_reg = inst.in_reg_num;
+		}
 	}
 
 final:
@@ -307,3 +310,107 @@ error:
 	inst.inst_len = 0;
 	return inst;
 }
+
+static struct mmio_decode_entry *
+decode_cache_entry(const struct guest_paging_structures *pg_structs, u64 rip)
+{
+	struct mmio_decode_cache *cache = &this_cpu_data()->mmio_decode_cache;
+
+	return &cache->entries[(rip ^ (rip >> 8) ^ pg_structs->root_table_gphys)
+			       % MMIO_DECODE_CACHE_ENTRIES];
+}
+
+/*
+ * Code may change under the same address space and RIP, e.g. when a module
+ * is reloaded at the same address or patched at runtime. Only use an entry
+ * if the instruction bytes provided with the exit are still the ones that
+ * were decoded.
+ */
+static bool decode_entry_valid(const struct mmio_decode_entry *entry,
+			       const u8 *bytes, unsigned int size)
+{
+	unsigned int n;
+
+	if (entry->inst.inst_len > size)
+		return false;
+
+	for (n = 0; n < entry->inst.inst_len; n++)
+		if (bytes[n] != entry->bytes[n])
+			return false;
+	return true;
+}
+
+struct mmio_instruction
+x86_mmio_parse(const struct guest_paging_structures *pg_structs, bool is_write)
+{
+	union registers *guest_regs = &this_cpu_data()->guest_regs;
+	u32 *stats = this_cpu_public()->stats;
+	struct guest_paging_structures key = *pg_structs;
+	u16 cs_attr = vcpu_vendor_get_cs_attr();
+	u64 rip = vcpu_vendor_get_rip();
+	struct mmio_decode_entry *entry;
+	struct mmio_instruction inst;
+	unsigned int exit_size;
+	const u8 *exit_bytes;
+	int out_reg = -1;
+
+	/*
+	 * Validating a cached entry against guest memory would cost as much as
+	 * decoding the instruction again. Only use the cache if the exit
+	 * provides the instruction bytes.
+	 */
+	exit_bytes = vcpu_get_exit_inst_bytes(&exit_size);
+	if (!exit_bytes)
+		return parse_instruction(pg_structs, is_write, &out_reg);
+
+	/* root_table_gphys is undefined if guest paging is off */
+	if (!key.root_paging)
+		key.root_table_gphys = 0;
+
+	entry = decode_cache_entry(&key, rip);
+	if (entry->inst.inst_len != 0 && entry->rip == rip &&
+	    entry->root_paging == key.root_paging &&
+	    entry->root_table_gphys == key.root_table_gphys &&
+	    entry->cs_attr == cs_attr && entry->is_write == is_write &&
+	    decode_entry_valid(entry, exit_bytes, exit_size)) {
+		stats[JAILHOUSE_CPU_STAT_MMIO_DECODE_HITS]++;
+		inst = entry->inst;
+		if (entry->out_reg >= 0)
+			inst.out_val = guest_regs->by_index[entry->out_reg];
+		return inst;
+	}
+
+	stats[JAILHOUSE_CPU_STAT_MMIO_DECODE_MISSES]++;
+	inst = parse_instruction(pg_structs, is_write, &out_reg);
+	if (inst.inst_len == 0)
+		return inst;
+
+	/* the CPU may have fetched only a part of the instruction */
+	if (inst.inst_len > exit_size || inst.inst_len > X86_MAX_INST_LEN) {
+		entry->inst.inst_len = 0;
+		return inst;
+	}
+	memcpy(entry->bytes, exit_bytes, inst.inst_len);
+
+	entry->root_paging = key.root_paging;
+	entry->root_table_gphys = key.root_table_gphys;
+	entry->rip = rip;
+	entry->cs_attr = cs_attr;
+	entry->is_write = is_write;
+	entry->out_reg = out_reg;
+	entry->inst = inst;
+
+	return inst;
+}
+
+/**
+ * Invalidate the MMIO instruction decode cache of the calling CPU.
+ *
+ * @note Must be called when the guest state is reset or the cell's memory
+ * layout changes as cached instructions may no longer match guest memory.
+ */
+void x86_mmio_invalidate_decode_cache(void)
+{
+	memset(&this_cpu_data()->mmio_decode_cache, 0,
+	       sizeof(this_cpu_data()->mmio_decode_cache));
+}
@@ -16,6 +16,7 @@
 #include <jailhouse/paging.h>
 #include <jailhouse/printk.h>
 #include <jailhouse/processor.h>
+#include <jailhouse/string.h>
 #include <asm/apic.h>
 #include <asm/vcpu.h>
 
@@ -53,6 +54,7 @@ int arch_init_early(void)
 	int err;
 
 	cache_line_size = (cpuid_ebx(1, 0) & 0xff00) >> 5;
+	enhanced_rep_movsb = !!(cpuid_ebx(7, 0) & X86_FEATURE_ERMS);
 
 	err = apic_init();
 	if (err)
@@ -113,6 +115,36 @@ static void set_cs(u16 cs)
 		: : "m" (cs) : "rax");
 }
 
+/*
+ * Derive an ID for the cache of the given level that the calling CPU is
+ * attached to. CPUs sharing the cache get the same ID. If the CPU does not
+ * describe the cache, all CPUs are considered to share it.
+ */
+static u32 cache_id(u32 apic_id, unsigned int level)
+{
+	unsigned int subleaf, sharing, shift = 0;
+	u32 eax;
+
+	if (cpuid_eax(0, 0) < 4)
+		return 0;
+
+	for (subleaf = 0; ; subleaf++) {
+		eax = cpuid_eax(4, subleaf);
+		if ((eax & CPUID_CACHE_TYPE_MASK) == 0)
+			return 0;
+		if ((eax & CPUID_CACHE_LEVEL_MASK) >> CPUID_CACHE_LEVEL_SHIFT ==
+		    level)
+			break;
+	}
+
+	sharing = ((eax & CPUID_CACHE_SHARING_MASK) >>
+		   CPUID_CACHE_SHARING_SHIFT) + 1;
+	while ((1U << shift) < sharing)
+		shift++;
+
+	return apic_id >> shift;
+}
+
 int arch_cpu_init(struct per_cpu *cpu_data)
 {
 	struct desc_table_reg dtr;
@@ -198,6 +230,9 @@ int arch_cpu_init(struct per_cpu *cpu_data)
 	if (err)
 		return err;
 
+	cpu_data->public.l2_cache_id = cache_id(cpu_data->public.apic_id, 2);
+	cpu_data->public.l3_cache_id = cache_id(cpu_data->public.apic_id, 3);
+
 	return vcpu_init(cpu_data);
 }
 
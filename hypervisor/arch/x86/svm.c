@@ -43,9 +43,12 @@
 /* IOPM size: two 4-K pages + 3 bits */
 #define IOPM_PAGES			3
 
+/* MSRPM size: two 4-K pages */
+#define MSRPM_PAGES			2
+
 #define NPT_IOMMU_PAGE_DIR_LEVELS	4
 
-static bool has_avic, has_assists, has_flush_by_asid;
+static bool has_assists, has_nrip_save, has_flush_by_asid;
 
 static const struct segment invalid_seg;
 
@@ -90,8 +93,6 @@ static u8 __attribute__((aligned(PAGE_SIZE))) msrpm[][0x2000/4] = {
 	}
 };
 
-static void *avic_page;
-
 static int svm_check_features(void)
 {
 	/* SVM is available */
@@ -106,10 +107,15 @@ static int svm_check_features(void)
 	if ((cpuid_edx(0x8000000A, 0) & X86_FEATURE_DECODE_ASSISTS))
 		has_assists = true;
 
-	/* AVIC support */
-	/* FIXME: Jailhouse support is incomplete so far
-	if (cpuid_edx(0x8000000A, 0) & X86_FEATURE_AVIC)
-		has_avic = true; */
+	/* Next RIP saved on instruction intercepts */
+	if (cpuid_edx(0x8000000A, 0) & X86_FEATURE_NRIP_SAVE)
+		has_nrip_save = true;
+
+	/*
+	 * AVIC is not used: it would back the guest APIC with a virtual page
+	 * while cells drive the physical xAPIC directly. Reads of the latter
+	 * are already passed through, see vcpu_vendor_cell_init.
+	 */
 
 	/* TLB Flush by ASID support */
 	if (cpuid_edx(0x8000000A, 0) & X86_FEATURE_FLUSH_BY_ASID)
@@ -138,6 +144,9 @@ static void set_svm_segment_from_segment(struct svm_segment *svm_segment,
 static void svm_set_cell_config(struct cell *cell, struct vmcb *vmcb)
 {
 	vmcb->iopm_base_pa = paging_hvirt2phys(cell->arch.io_bitmap);
+	vmcb->msrpm_base_pa = paging_hvirt2phys(cell->arch.msr_bitmap ?
+						cell->arch.msr_bitmap :
+						(u8 *)msrpm);
 	vmcb->n_cr3 =
 		paging_hvirt2phys(cell->arch.svm.npt_iommu_structs.root_table);
 }
@@ -212,14 +221,10 @@ static void vmcb_setup(struct per_cpu *cpu_data)
 	 */
 	vmcb->exception_intercepts |= (1 << DB_VECTOR) | (1 << AC_VECTOR);
 
-	vmcb->msrpm_base_pa = paging_hvirt2phys(msrpm);
-
 	vmcb->np_enable = 1;
 	/* No more than one guest owns the CPU */
 	vmcb->guest_asid = 1;
 
-	/* TODO: Setup AVIC */
-
 	/* Explicitly mark all of the state as new */
 	vmcb->clean_bits = 0;
 
@@ -233,6 +238,16 @@ unsigned long arch_paging_gphys2phys(unsigned long gphys,
 				gphys, flags);
 }
 
+const struct paging_structures *arch_paging_cell_structs(struct cell *cell)
+{
+	return &cell->arch.svm.npt_iommu_structs;
+}
+
+bool arch_paging_cell_structs_shared(struct cell *cell)
+{
+	return true;
+}
+
 static void npt_iommu_set_next_pt_l4(pt_entry_t pte, unsigned long next_pt)
 {
 	/*
@@ -307,12 +322,6 @@ int vcpu_vendor_early_init(void)
 		memset(&msrpm[SVM_MSRPM_0000][MSR_X2APIC_BASE/4], 0,
 				(MSR_X2APIC_END - MSR_X2APIC_BASE + 1)/4);
 		msrpm[SVM_MSRPM_0000][MSR_X2APIC_ICR/4] = 0x02;
-	} else {
-		if (has_avic) {
-			avic_page = page_alloc(&remap_pool, 1);
-			if (!avic_page)
-				return trace_error(-ENOMEM);
-		}
 	}
 
 	return vcpu_cell_init(&root_cell);
@@ -327,21 +336,13 @@ int vcpu_vendor_cell_init(struct cell *cell)
 	cell->arch.svm.npt_iommu_structs.root_table =
 		(page_table_t)cell->arch.root_table_page;
 
-	if (!has_avic) {
-		/*
-		 * Map xAPIC as is; reads are passed, writes are trapped.
-		 */
-		flags = PAGE_READONLY_FLAGS | PAGE_FLAG_US | PAGE_FLAG_DEVICE;
-		return paging_create(&cell->arch.svm.npt_iommu_structs,
-				     XAPIC_BASE, PAGE_SIZE, XAPIC_BASE, flags,
-				     PAGING_NON_COHERENT | PAGING_NO_HUGE);
-	} else {
-		flags = PAGE_DEFAULT_FLAGS | PAGE_FLAG_DEVICE;
-		return paging_create(&cell->arch.svm.npt_iommu_structs,
-				     paging_hvirt2phys(avic_page),
-				     PAGE_SIZE, XAPIC_BASE, flags,
-				     PAGING_NON_COHERENT | PAGING_NO_HUGE);
-	}
+	/*
+	 * Map xAPIC as is; reads are passed, writes are trapped.
+	 */
+	flags = PAGE_READONLY_FLAGS | PAGE_FLAG_US | PAGE_FLAG_DEVICE;
+	return paging_create(&cell->arch.svm.npt_iommu_structs,
+			     XAPIC_BASE, PAGE_SIZE, XAPIC_BASE, flags,
+			     PAGING_NON_COHERENT | PAGING_NO_HUGE);
 }
 
 int vcpu_map_memory_region(struct cell *cell,
@@ -744,7 +745,8 @@ static bool svm_handle_cr(struct per_cpu *cpu_data)
 			panic_printk("FATAL: Unsupported CR access (LMSW or CLTS)\n");
 			return false;
 		}
-		reg = vmcb->exitinfo1 & 0x07;
+		/* GPR number in bits 3:0, covers REX-prefixed r8..r15 */
+		reg = vmcb->exitinfo1 & 0x0f;
 	} else {
 		if (!svm_parse_mov_to_cr(vmcb, vmcb->rip, 0, &reg)) {
 			panic_printk("FATAL: Unable to parse MOV-to-CR instruction\n");
@@ -757,7 +759,11 @@ static bool svm_handle_cr(struct per_cpu *cpu_data)
 	else
 		val = cpu_data->guest_regs.by_index[15 - reg];
 
-	vcpu_skip_emulated_instruction(X86_INST_LEN_MOV_TO_CR);
+	/* Only NRIP accounts for prefixes that the parser does not support */
+	if (has_nrip_save)
+		vmcb->rip = vmcb->nextrip;
+	else
+		vcpu_skip_emulated_instruction(X86_INST_LEN_MOV_TO_CR);
 	/* Flush TLB on PG/WP/CD/NW change: See APMv2, Sect. 15.16 */
 	bits = (X86_CR0_PG | X86_CR0_WP | X86_CR0_CD | X86_CR0_NW);
 	if ((val ^ vmcb->cr0) & bits)
@@ -792,10 +798,6 @@ static bool svm_handle_msr_write(struct per_cpu *cpu_data)
 	return vcpu_handle_msr_write();
 }
 
-/*
- * TODO: This handles unaccelerated (non-AVIC) access. AVIC should
- * be treated separately in svm_handle_avic_access().
- */
 static bool svm_handle_apic_access(struct vmcb *vmcb)
 {
 	struct guest_paging_structures pg_structs;
@@ -880,9 +882,14 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 	cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_TOTAL]++;
 	/*
 	 * All guest state is marked unmodified; individual handlers must clear
-	 * the bits as needed.
+	 * the bits as needed. Reserved bits have to stay zero.
 	 */
-	vmcb->clean_bits = 0xffffffff;
+	vmcb->clean_bits = CLEAN_BITS_ALL;
+	/*
+	 * The CPU does not reset a requested TLB flush after performing it.
+	 * Handlers that need another one will request it via vcpu_tlb_flush.
+	 */
+	vmcb->tlb_control = SVM_TLB_FLUSH_NONE;
 
 	switch (vmcb->exitcode) {
 	case VMEXIT_INVALID:
@@ -918,7 +925,7 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 		if ((vmcb->exitinfo1 & 0x7) == 0x7 &&
 		     vmcb->exitinfo2 >= XAPIC_BASE &&
 		     vmcb->exitinfo2 < XAPIC_BASE + PAGE_SIZE) {
-			/* APIC access in non-AVIC mode */
+			/* xAPIC write, reads are passed through */
 			cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_XAPIC]++;
 			if (svm_handle_apic_access(vmcb))
 				goto vmentry;
@@ -946,7 +953,6 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 		}
 		x86_check_events();
 		goto vmentry;
-	/* TODO: Handle VMEXIT_AVIC_NOACCEL and VMEXIT_AVIC_INCOMPLETE_IPI */
 	default:
 		panic_printk("FATAL: Unexpected #VMEXIT, exitcode %llx, "
 			     "exitinfo1 0x%016llx exitinfo2 0x%016llx\n",
@@ -998,16 +1004,30 @@ const u8 *vcpu_get_inst_bytes(const struct guest_paging_structures *pg_structs,
 	if (has_assists) {
 		if (!*size)
 			return NULL;
-		start = vmcb->rip - pc;
+		start = pc - vmcb->rip;
 		if (start < vmcb->bytes_fetched) {
-			*size = vmcb->bytes_fetched - start;
+			*size = MIN(*size, vmcb->bytes_fetched - start);
 			return &vmcb->guest_bytes[start];
-		} else {
-			return NULL;
 		}
-	} else {
-		return vcpu_map_inst(pg_structs, pc, size);
 	}
+
+	/*
+	 * The CPU may fetch fewer bytes than needed or none at all, e.g. when
+	 * the instruction crosses into an unmapped page. Walk the guest page
+	 * tables then.
+	 */
+	return vcpu_map_inst(pg_structs, pc, size);
+}
+
+const u8 *vcpu_get_exit_inst_bytes(unsigned int *size)
+{
+	struct vmcb *vmcb = &this_cpu_data()->vmcb;
+
+	if (!has_assists)
+		return NULL;
+
+	*size = vmcb->bytes_fetched;
+	return vmcb->guest_bytes;
 }
 
 unsigned int vcpu_vendor_get_io_bitmap_pages(void)
@@ -1015,6 +1035,32 @@ unsigned int vcpu_vendor_get_io_bitmap_pages(void)
 	return IOPM_PAGES;
 }
 
+unsigned int vcpu_vendor_get_msr_bitmap_pages(void)
+{
+	return MSRPM_PAGES;
+}
+
+void vcpu_vendor_msr_allow_access(u8 *cell_msrpm, u32 msr, bool is_write)
+{
+	unsigned int vector, bit;
+
+	if (msr <= 0x1fff)
+		vector = SVM_MSRPM_0000;
+	else if (msr - 0xc0000000 <= 0x1fff)
+		vector = SVM_MSRPM_C000;
+	else if (msr - 0xc0010000 <= 0x1fff)
+		vector = SVM_MSRPM_C001;
+	else
+		/* not covered by the permissions map, always intercepted */
+		return;
+
+	/* two bits per MSR, read intercept first */
+	bit = (msr & 0x1fff) * 2 + (is_write ? 1 : 0);
+	if (!(msrpm[vector][bit / 8] & (1 << (bit % 8))))
+		cell_msrpm[vector * sizeof(msrpm[0]) + bit / 8] &=
+			~(1 << (bit % 8));
+}
+
 #define VCPU_VENDOR_GET_REGISTER(__reg__)	\
 u64 vcpu_vendor_get_##__reg__(void)		\
 {						\
@@ -31,6 +31,11 @@
 	     (counter) < (config)->num_pio_regions;		\
 	     (pio)++, (counter)++)
 
+#define for_each_msr_region(msr, config, counter)		\
+	for ((msr) = jailhouse_cell_msr(config), (counter) = 0;	\
+	     (counter) < (config)->num_msr_regions;		\
+	     (msr)++, (counter)++)
+
 static u8 __attribute__((aligned(PAGE_SIZE))) parking_code[PAGE_SIZE] = {
 	0xfa, /* 1: cli */
 	0xf4, /*    hlt */
@@ -57,6 +62,12 @@ const u8 *vcpu_get_inst_bytes(const struct guest_paging_structures *pg_structs,
 			      unsigned long pc, unsigned int *size)
 	__attribute__((weak, alias("vcpu_map_inst")));
 
+/* Can be overridden in vendor-specific code if needed */
+const u8 * __attribute__((weak)) vcpu_get_exit_inst_bytes(unsigned int *size)
+{
+	return NULL;
+}
+
 const u8 *vcpu_map_inst(const struct guest_paging_structures *pg_structs,
 			unsigned long pc, unsigned int *size)
 {
@@ -92,9 +103,57 @@ static void pio_allow_access(u8 *bm, const struct jailhouse_pio *pio,
 		access_method(start_bit, (unsigned long*)bm);
 }
 
+/* MSR ranges that intercept bitmaps can cover, in units of MSRs */
+static const u32 msr_bitmap_windows[] = { 0x00000000, 0xc0000000, 0xc0010000 };
+#define MSR_BITMAP_WINDOW_SIZE	0x2000
+
+/*
+ * Build the private MSR bitmap of a cell that comes with an MSR whitelist.
+ * Everything is intercepted, except for the listed MSRs that the hypervisor
+ * does not need to intercept on its own.
+ */
+static int msr_bitmap_init(struct cell *cell)
+{
+	const struct jailhouse_msr *msr;
+	u32 index, last, start, end;
+	unsigned int n, w;
+
+	memset(cell->arch.msr_bitmap, -1,
+	       vcpu_vendor_get_msr_bitmap_pages() * PAGE_SIZE);
+
+	for_each_msr_region(msr, cell->config, n) {
+		if ((msr->flags & ~JAILHOUSE_MSR_RW) || msr->length == 0)
+			return trace_error(-EINVAL);
+		last = msr->base + msr->length - 1;
+		if (last < msr->base)
+			return trace_error(-EINVAL);
+
+		/* MSRs outside of the windows are intercepted anyway */
+		for (w = 0; w < ARRAY_SIZE(msr_bitmap_windows); w++) {
+			start = MAX(msr->base, msr_bitmap_windows[w]);
+			end = MIN(last, msr_bitmap_windows[w] +
+				  MSR_BITMAP_WINDOW_SIZE - 1);
+			for (index = start; index <= end; index++) {
+				if (msr->flags & JAILHOUSE_MSR_READ)
+					vcpu_vendor_msr_allow_access(
+						cell->arch.msr_bitmap, index,
+						false);
+				if (msr->flags & JAILHOUSE_MSR_WRITE)
+					vcpu_vendor_msr_allow_access(
+						cell->arch.msr_bitmap, index,
+						true);
+			}
+		}
+	}
+
+	return 0;
+}
+
 int vcpu_cell_init(struct cell *cell)
 {
 	const unsigned int io_bitmap_pages = vcpu_vendor_get_io_bitmap_pages();
+	const unsigned int msr_bitmap_pages =
+		vcpu_vendor_get_msr_bitmap_pages();
 	const struct jailhouse_pio *pio;
 	unsigned int n, pm_timer_addr;
 	int err;
@@ -103,12 +162,23 @@ int vcpu_cell_init(struct cell *cell)
 	if (!cell->arch.io_bitmap)
 		return -ENOMEM;
 
-	err = vcpu_vendor_cell_init(cell);
-	if (err) {
-		page_free(&mem_pool, cell->arch.io_bitmap, io_bitmap_pages);
-		return err;
+	/* without a whitelist, the cell uses the shared MSR bitmap */
+	if (cell->config->num_msr_regions > 0) {
+		cell->arch.msr_bitmap = page_alloc(&mem_pool,
+						   msr_bitmap_pages);
+		if (!cell->arch.msr_bitmap) {
+			err = -ENOMEM;
+			goto err_free_io_bitmap;
+		}
+		err = msr_bitmap_init(cell);
+		if (err)
+			goto err_free_msr_bitmap;
 	}
 
+	err = vcpu_vendor_cell_init(cell);
+	if (err)
+		goto err_free_msr_bitmap;
+
 	/* initialize io bitmap to trap all accesses */
 	memset(cell->arch.io_bitmap, -1, io_bitmap_pages * PAGE_SIZE);
 
@@ -144,6 +214,12 @@ int vcpu_cell_init(struct cell *cell)
 				~(1 << (pm_timer_addr % 8));
 
 	return 0;
+
+err_free_msr_bitmap:
+	page_free(&mem_pool, cell->arch.msr_bitmap, msr_bitmap_pages);
+err_free_io_bitmap:
+	page_free(&mem_pool, cell->arch.io_bitmap, io_bitmap_pages);
+	return err;
 }
 
 void vcpu_cell_exit(struct cell *cell)
@@ -170,6 +246,8 @@ void vcpu_cell_exit(struct cell *cell)
 
 	page_free(&mem_pool, cell->arch.io_bitmap,
 		  vcpu_vendor_get_io_bitmap_pages());
+	page_free(&mem_pool, cell->arch.msr_bitmap,
+		  vcpu_vendor_get_msr_bitmap_pages());
 
 	vcpu_vendor_cell_exit(cell);
 }
@@ -425,6 +503,7 @@ void vcpu_reset(unsigned int sipi_vector)
 	struct per_cpu *cpu_data = this_cpu_data();
 
 	vcpu_vendor_reset(sipi_vector);
+	x86_mmio_invalidate_decode_cache();
 
 	memset(&cpu_data->guest_regs, 0, sizeof(cpu_data->guest_regs));
 
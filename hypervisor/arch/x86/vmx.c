@@ -29,6 +29,7 @@
 #define CR4_IDX			1
 
 #define PIO_BITMAP_PAGES	2
+#define MSR_BITMAP_PAGES	1
 
 static const struct segment invalid_seg = {
 	.access_rights = 0x10000
@@ -335,6 +336,16 @@ unsigned long arch_paging_gphys2phys(unsigned long gphys, unsigned long flags)
 				flags);
 }
 
+const struct paging_structures *arch_paging_cell_structs(struct cell *cell)
+{
+	return &cell->arch.vmx.ept_structs;
+}
+
+bool arch_paging_cell_structs_shared(struct cell *cell)
+{
+	return cell->arch.vtd.ept_shared;
+}
+
 int vcpu_vendor_cell_init(struct cell *cell)
 {
 	/* build root EPT of cell */
@@ -342,6 +353,16 @@ int vcpu_vendor_cell_init(struct cell *cell)
 	cell->arch.vmx.ept_structs.root_table =
 		(page_table_t)cell->arch.root_table_page;
 
+	if (!using_x2apic)
+		/*
+		 * Map xAPIC as is, uncached; reads are passed, writes are
+		 * trapped as EPT violations.
+		 */
+		return paging_create(&cell->arch.vmx.ept_structs,
+				     XAPIC_BASE, PAGE_SIZE, XAPIC_BASE,
+				     EPT_FLAG_READ | (EPT_TYPE_UNCACHEABLE << 3),
+				     PAGING_NON_COHERENT | PAGING_NO_HUGE);
+
 	/* Map the special APIC access page into the guest's physical address
 	 * space at the default address (XAPIC_BASE) */
 	return paging_create(&cell->arch.vmx.ept_structs,
@@ -445,7 +466,7 @@ unsigned long vcpu_vendor_get_guest_cr4(void)
 static bool vmx_set_cell_config(void)
 {
 	struct cell *cell = this_cell();
-	u8 *io_bitmap;
+	u8 *io_bitmap, *cell_msr_bitmap;
 	bool ok = true;
 
 	io_bitmap = cell->arch.io_bitmap;
@@ -453,6 +474,11 @@ static bool vmx_set_cell_config(void)
 	ok &= vmcs_write64(IO_BITMAP_B,
 			   paging_hvirt2phys(io_bitmap + PAGE_SIZE));
 
+	cell_msr_bitmap = cell->arch.msr_bitmap;
+	if (!cell_msr_bitmap)
+		cell_msr_bitmap = (u8 *)msr_bitmap;
+	ok &= vmcs_write64(MSR_BITMAP, paging_hvirt2phys(cell_msr_bitmap));
+
 	ok &= vmcs_write64(EPT_POINTER,
 		paging_hvirt2phys(cell->arch.vmx.ept_structs.root_table) |
 		EPT_TYPE_WRITEBACK | EPT_PAGE_WALK_LEN);
@@ -570,8 +596,6 @@ static bool vmcs_setup(void)
 	val &= ~(CPU_BASED_CR3_LOAD_EXITING | CPU_BASED_CR3_STORE_EXITING);
 	ok &= vmcs_write32(CPU_BASED_VM_EXEC_CONTROL, val);
 
-	ok &= vmcs_write64(MSR_BITMAP, paging_hvirt2phys(msr_bitmap));
-
 	val = read_msr(MSR_IA32_VMX_PROCBASED_CTLS2);
 	val |= SECONDARY_EXEC_VIRTUALIZE_APIC_ACCESSES |
 		SECONDARY_EXEC_ENABLE_EPT | SECONDARY_EXEC_UNRESTRICTED_GUEST |
@@ -1039,10 +1063,26 @@ void vcpu_vendor_set_guest_pat(unsigned long val)
 	vmcs_write64(GUEST_IA32_PAT, val);
 }
 
-static bool vmx_handle_apic_access(void)
+static bool vmx_emulate_apic_access(unsigned int offset, bool is_write)
 {
 	struct guest_paging_structures pg_structs;
-	unsigned int inst_len, offset;
+	unsigned int inst_len;
+
+	if (offset & 0x00f)
+		return false;
+
+	vcpu_get_guest_paging_structs(&pg_structs);
+
+	inst_len = apic_mmio_access(&pg_structs, offset >> 4, is_write);
+	if (!inst_len)
+		return false;
+
+	vcpu_skip_emulated_instruction(inst_len);
+	return true;
+}
+
+static bool vmx_handle_apic_access(void)
+{
 	u64 qualification;
 	bool is_write;
 
@@ -1052,21 +1092,33 @@ static bool vmx_handle_apic_access(void)
 	case APIC_ACCESS_TYPE_LINEAR_READ:
 	case APIC_ACCESS_TYPE_LINEAR_WRITE:
 		is_write = !!(qualification & APIC_ACCESS_TYPE_LINEAR_WRITE);
-		offset = qualification & APIC_ACCESS_OFFSET_MASK;
-		if (offset & 0x00f)
-			break;
+		if (vmx_emulate_apic_access(qualification &
+					    APIC_ACCESS_OFFSET_MASK, is_write))
+			return true;
+		break;
+	}
+	panic_printk("FATAL: Unhandled APIC access, "
+		     "qualification %llx\n", qualification);
+	return false;
+}
 
-		vcpu_get_guest_paging_structs(&pg_structs);
+/* Write to the read-only xAPIC mapping used when not in x2APIC mode */
+static bool vmx_is_xapic_write(void)
+{
+	u64 gphys = vmcs_read64(GUEST_PHYSICAL_ADDRESS);
 
-		inst_len = apic_mmio_access(&pg_structs, offset >> 4, is_write);
-		if (!inst_len)
-			break;
+	return !using_x2apic && gphys >= XAPIC_BASE &&
+		gphys < XAPIC_BASE + PAGE_SIZE;
+}
 
-		vcpu_skip_emulated_instruction(inst_len);
+static bool vmx_handle_xapic_write(void)
+{
+	unsigned long offset = vmcs_read64(GUEST_PHYSICAL_ADDRESS) - XAPIC_BASE;
+
+	if (vmx_emulate_apic_access(offset, true))
 		return true;
-	}
-	panic_printk("FATAL: Unhandled APIC access, "
-		     "qualification %llx\n", qualification);
+
+	panic_printk("FATAL: Unhandled APIC access, offset %ld\n", offset);
 	return false;
 }
 
@@ -1201,6 +1253,12 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 			return;
 		break;
 	case EXIT_REASON_EPT_VIOLATION:
+		if (vmx_is_xapic_write()) {
+			stats[JAILHOUSE_CPU_STAT_VMEXITS_XAPIC]++;
+			if (vmx_handle_xapic_write())
+				return;
+			break;
+		}
 		stats[JAILHOUSE_CPU_STAT_VMEXITS_MMIO]++;
 		if (vcpu_handle_mmio_access())
 			return;
@@ -1229,6 +1287,29 @@ unsigned int vcpu_vendor_get_io_bitmap_pages(void)
 	return PIO_BITMAP_PAGES;
 }
 
+unsigned int vcpu_vendor_get_msr_bitmap_pages(void)
+{
+	return MSR_BITMAP_PAGES;
+}
+
+void vcpu_vendor_msr_allow_access(u8 *cell_bitmap, u32 msr, bool is_write)
+{
+	unsigned int bmp;
+
+	if (msr <= 0x1fff)
+		bmp = is_write ? VMX_MSR_BMP_0000_WRITE : VMX_MSR_BMP_0000_READ;
+	else if (msr - 0xc0000000 <= 0x1fff)
+		bmp = is_write ? VMX_MSR_BMP_C000_WRITE : VMX_MSR_BMP_C000_READ;
+	else
+		/* not covered by the bitmap, always intercepted */
+		return;
+
+	msr &= 0x1fff;
+	if (!(msr_bitmap[bmp][msr / 8] & (1 << (msr % 8))))
+		cell_bitmap[bmp * sizeof(msr_bitmap[0]) + msr / 8] &=
+			~(1 << (msr % 8));
+}
+
 #define VCPU_VENDOR_GET_REGISTER(__reg__, __field__)	\
 u64 vcpu_vendor_get_##__reg__(void)			\
 {							\
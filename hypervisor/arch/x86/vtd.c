@@ -42,6 +42,18 @@ struct vtd_entry {
 	u64 hi_word;
 };
 
+/* well below the queue size of PAGE_SIZE / sizeof(struct vtd_entry) */
+#define VTD_INV_BATCH_SIZE		16
+
+/*
+ * Invalidation requests that are submitted to all units together, completed
+ * by a single wait descriptor per unit.
+ */
+struct vtd_inv_batch {
+	unsigned int count;
+	struct vtd_entry requests[VTD_INV_BATCH_SIZE];
+};
+
 #define VTD_PAGE_READ			0x00000001
 #define VTD_PAGE_WRITE			0x00000002
 
@@ -52,13 +64,18 @@ struct vtd_entry {
 # define VTD_VER_MIN			0x10
 #define VTD_CAP_REG			0x08
 # define VTD_CAP_NUM_DID_MASK		BIT_MASK(2, 0)
+# define VTD_CAP_CM			(1UL << 7)
 # define VTD_CAP_SAGAW39		(1UL << 9)
 # define VTD_CAP_SAGAW48		(1UL << 10)
 # define VTD_CAP_SLLPS2M		(1UL << 34)
 # define VTD_CAP_SLLPS1G		(1UL << 35)
 # define VTD_CAP_FRO_MASK		BIT_MASK(33, 24)
+# define VTD_CAP_PSI			(1UL << 39)
 # define VTD_CAP_NFR_MASK		BIT_MASK(47, 40)
+# define VTD_CAP_MAMV_MASK		BIT_MASK(53, 48)
+# define VTD_CAP_MAMV_SHIFT		48
 #define VTD_ECAP_REG			0x10
+# define VTD_ECAP_C			(1UL << 0)
 # define VTD_ECAP_QI			(1UL << 1)
 # define VTD_ECAP_IR			(1UL << 3)
 # define VTD_ECAP_EIM			(1UL << 4)
@@ -106,9 +123,11 @@ struct vtd_entry {
 #define VTD_REQ_INV_IOTLB		0x02
 # define VTD_INV_IOTLB_GLOBAL		(1UL << 4)
 # define VTD_INV_IOTLB_DOMAIN		(2UL << 4)
+# define VTD_INV_IOTLB_PAGE		(3UL << 4)
 # define VTD_INV_IOTLB_DW		(1UL << 6)
 # define VTD_INV_IOTLB_DR		(1UL << 7)
 # define VTD_INV_IOTLB_DOMAIN_SHIFT	16
+# define VTD_INV_IOTLB_AM_MASK		BIT_MASK(5, 0)
 
 #define VTD_REQ_INV_INT			0x04
 # define VTD_INV_INT_GLOBAL		(0UL << 4)
@@ -200,6 +219,11 @@ static void *unit_inv_queue;
 static unsigned int dmar_units;
 static unsigned int dmar_pt_levels;
 static unsigned int dmar_num_did = ~0U;
+/* largest page-selective invalidation order of all units, -1 if none */
+static int dmar_psi_max_order = VTD_INV_IOTLB_AM_MASK;
+static bool dmar_caching_mode;
+/* all units can walk the EPT as second-level page tables */
+static bool dmar_ept_sharing;
 static spinlock_t inv_queue_lock;
 static struct vtd_emulation root_cell_units[JAILHOUSE_MAX_IOMMU_UNITS];
 static bool dmar_units_initialized;
@@ -220,8 +244,9 @@ static unsigned int inv_queue_write(void *inv_queue, unsigned int index,
 	return (index + 1) % (PAGE_SIZE / sizeof(*entry));
 }
 
-static void vtd_submit_iq_request(void *reg_base, void *inv_queue,
-				  const struct vtd_entry *inv_request)
+static void vtd_submit_iq_requests(void *reg_base, void *inv_queue,
+				   const struct vtd_entry *inv_requests,
+				   unsigned int count)
 {
 	struct vtd_entry inv_wait = {
 		.lo_word = VTD_REQ_INV_WAIT | VTD_INV_WAIT_SW |
@@ -229,7 +254,7 @@ static void vtd_submit_iq_request(void *reg_base, void *inv_queue,
 		.hi_word = paging_hvirt2phys(
 				&per_cpu(this_cpu_id())->vtd_iq_completed),
 	};
-	unsigned int index;
+	unsigned int index, n;
 
 	this_cpu_data()->vtd_iq_completed = 0;
 
@@ -237,8 +262,8 @@ static void vtd_submit_iq_request(void *reg_base, void *inv_queue,
 
 	index = mmio_read64_field(reg_base + VTD_IQT_REG, VTD_IQT_QT_MASK);
 
-	if (inv_request)
-		index = inv_queue_write(inv_queue, index, *inv_request);
+	for (n = 0; n < count; n++)
+		index = inv_queue_write(inv_queue, index, inv_requests[n]);
 	index = inv_queue_write(inv_queue, index, inv_wait);
 
 	mmio_write64_field(reg_base + VTD_IQT_REG, VTD_IQT_QT_MASK, index);
@@ -249,8 +274,65 @@ static void vtd_submit_iq_request(void *reg_base, void *inv_queue,
 	spin_unlock(&inv_queue_lock);
 }
 
-static void vtd_flush_domain_caches(unsigned int did)
+static void vtd_submit_iq_request(void *reg_base, void *inv_queue,
+				  const struct vtd_entry *inv_request)
+{
+	vtd_submit_iq_requests(reg_base, inv_queue, inv_request,
+			       inv_request ? 1 : 0);
+}
+
+static void vtd_inv_batch_submit(struct vtd_inv_batch *batch)
 {
+	void *inv_queue = unit_inv_queue;
+	void *reg_base = dmar_reg_base;
+	unsigned int n;
+
+	if (batch->count == 0)
+		return;
+
+	for (n = 0; n < dmar_units; n++) {
+		vtd_submit_iq_requests(reg_base, inv_queue, batch->requests,
+				       batch->count);
+		reg_base += DMAR_MMIO_SIZE;
+		inv_queue += PAGE_SIZE;
+	}
+	batch->count = 0;
+}
+
+static void vtd_inv_batch_add(struct vtd_inv_batch *batch,
+			      struct vtd_entry inv_request)
+{
+	if (batch->count == VTD_INV_BATCH_SIZE)
+		vtd_inv_batch_submit(batch);
+	batch->requests[batch->count++] = inv_request;
+}
+
+struct vtd_psi_request {
+	struct vtd_inv_batch *batch;
+	unsigned int did;
+};
+
+static void vtd_queue_psi(void *arg, u64 addr, unsigned int order)
+{
+	struct vtd_psi_request *psi = arg;
+	const struct vtd_entry inv_pages = {
+		.lo_word = VTD_REQ_INV_IOTLB | VTD_INV_IOTLB_PAGE |
+			VTD_INV_IOTLB_DW | VTD_INV_IOTLB_DR |
+			(psi->did << VTD_INV_IOTLB_DOMAIN_SHIFT),
+		.hi_word = addr | order,
+	};
+
+	vtd_inv_batch_add(psi->batch, inv_pages);
+}
+
+/*
+ * Invalidate the IOTLB entries of the ranges queued for the cell, falling
+ * back to the whole domain if that is cheaper or required.
+ */
+static void vtd_flush_domain_caches(struct vtd_inv_batch *batch,
+				    struct cell *cell)
+{
+	unsigned int did = cell->config->id;
 	const struct vtd_entry inv_context = {
 		.lo_word = VTD_REQ_INV_CONTEXT | VTD_INV_CONTEXT_DOMAIN |
 			(did << VTD_INV_CONTEXT_DOMAIN_SHIFT),
@@ -260,16 +342,18 @@ static void vtd_flush_domain_caches(unsigned int did)
 			VTD_INV_IOTLB_DW | VTD_INV_IOTLB_DR |
 			(did << VTD_INV_IOTLB_DOMAIN_SHIFT),
 	};
-	void *inv_queue = unit_inv_queue;
-	void *reg_base = dmar_reg_base;
-	unsigned int n;
+	struct vtd_psi_request psi = {
+		.batch = batch,
+		.did = did,
+	};
 
-	for (n = 0; n < dmar_units; n++) {
-		vtd_submit_iq_request(reg_base, inv_queue, &inv_context);
-		vtd_submit_iq_request(reg_base, inv_queue, &inv_iotlb);
-		reg_base += DMAR_MMIO_SIZE;
-		inv_queue += PAGE_SIZE;
-	}
+	vtd_inv_batch_add(batch, inv_context);
+	if (dmar_psi_max_order < 0 ||
+	    !iommu_flush_queued_blocks(cell, dmar_psi_max_order,
+				       vtd_queue_psi, &psi))
+		vtd_inv_batch_add(batch, inv_iotlb);
+
+	iommu_reset_flush_queue(cell);
 }
 
 static void vtd_update_gcmd_reg(void *reg_base, u32 mask, unsigned int set)
@@ -512,6 +596,9 @@ invalid_iq_entry:
 
 static void vtd_init_unit(void *reg_base, void *inv_queue)
 {
+	const struct vtd_entry inv_global[] = {
+		inv_global_context, inv_global_iotlb, inv_global_int,
+	};
 	void *fault_reg_base;
 	unsigned int nfr, n;
 
@@ -548,24 +635,21 @@ static void vtd_init_unit(void *reg_base, void *inv_queue)
 	mmio_write64(reg_base + VTD_IQA_REG, paging_hvirt2phys(inv_queue));
 	vtd_update_gcmd_reg(reg_base, VTD_GCMD_QIE, 1);
 
-	vtd_submit_iq_request(reg_base, inv_queue, &inv_global_context);
-	vtd_submit_iq_request(reg_base, inv_queue, &inv_global_iotlb);
-	vtd_submit_iq_request(reg_base, inv_queue, &inv_global_int);
+	vtd_submit_iq_requests(reg_base, inv_queue, inv_global,
+			       ARRAY_SIZE(inv_global));
 
 	vtd_update_gcmd_reg(reg_base, VTD_GCMD_TE, 1);
 	vtd_update_gcmd_reg(reg_base, VTD_GCMD_IRE, 1);
 }
 
-static void vtd_update_irte(unsigned int index, union vtd_irte content)
+static void vtd_update_irte(struct vtd_inv_batch *batch, unsigned int index,
+			    union vtd_irte content)
 {
 	const struct vtd_entry inv_int = {
 		.lo_word = VTD_REQ_INV_INT | VTD_INV_INT_INDEX |
 			((u64)index << VTD_INV_INT_IIDX_SHIFT),
 	};
 	union vtd_irte *irte = &int_remap_table[index];
-	void *inv_queue = unit_inv_queue;
-	void *reg_base = dmar_reg_base;
-	unsigned int n;
 
 	if (content.field.p) {
 		/*
@@ -586,11 +670,7 @@ static void vtd_update_irte(unsigned int index, union vtd_irte content)
 	}
 	arch_paging_flush_cpu_caches(irte, sizeof(*irte));
 
-	for (n = 0; n < dmar_units; n++) {
-		vtd_submit_iq_request(reg_base, inv_queue, &inv_int);
-		reg_base += DMAR_MMIO_SIZE;
-		inv_queue += PAGE_SIZE;
-	}
+	vtd_inv_batch_add(batch, inv_int);
 }
 
 static int vtd_find_int_remap_region(u16 device_id)
@@ -639,12 +719,14 @@ static void vtd_free_int_remap_region(u16 device_id, unsigned int length)
 {
 	union vtd_irte free_irte = { .field.p = 0, .field.assigned = 0 };
 	int pos = vtd_find_int_remap_region(device_id);
+	struct vtd_inv_batch batch = { .count = 0 };
 
 	if (pos >= 0) {
 		printk("Freeing %u interrupt(s) for device %02x:%02x.%x at "
 		       "index %d\n", length, PCI_BDF_PARAMS(device_id), pos);
 		while (length-- > 0)
-			vtd_update_irte(pos++, free_irte);
+			vtd_update_irte(&batch, pos++, free_irte);
+		vtd_inv_batch_submit(&batch);
 	}
 }
 
@@ -716,6 +798,28 @@ void iommu_remove_pci_device(struct pci_device *device)
 
 static void vtd_cell_exit(struct cell *cell);
 
+/*
+ * Sharing the EPT grants devices the same access as the cell's CPUs. This is
+ * only equivalent to separate tables if every region is DMA-capable. The
+ * communication region is backed by a page the cell owns anyway.
+ */
+static bool vtd_cell_can_share_ept(struct cell *cell)
+{
+	const struct jailhouse_memory *mem;
+	unsigned int n;
+
+	if (!dmar_ept_sharing)
+		return false;
+
+	for_each_mem_region(mem, cell->config, n)
+		if (!(mem->flags & (JAILHOUSE_MEM_DMA |
+				    JAILHOUSE_MEM_COMM_REGION)) &&
+		    !JAILHOUSE_MEMORY_IS_SUBPAGE(mem))
+			return false;
+
+	return true;
+}
+
 static int vtd_cell_init(struct cell *cell)
 {
 	const struct jailhouse_irqchip *irqchip =
@@ -727,10 +831,16 @@ static int vtd_cell_init(struct cell *cell)
 	if (cell->config->id >= dmar_num_did)
 		return trace_error(-ERANGE);
 
-	cell->arch.vtd.pg_structs.root_paging = vtd_paging;
-	cell->arch.vtd.pg_structs.root_table = page_alloc(&mem_pool, 1);
-	if (!cell->arch.vtd.pg_structs.root_table)
-		return -ENOMEM;
+	cell->arch.vtd.ept_shared = vtd_cell_can_share_ept(cell);
+	if (cell->arch.vtd.ept_shared) {
+		cell->arch.vtd.pg_structs = *arch_paging_cell_structs(cell);
+	} else {
+		cell->arch.vtd.pg_structs.root_paging = vtd_paging;
+		cell->arch.vtd.pg_structs.root_table =
+			page_alloc(&mem_pool, 1);
+		if (!cell->arch.vtd.pg_structs.root_table)
+			return -ENOMEM;
+	}
 
 	/* reserve regions for IRQ chips (if not done already) */
 	for (n = 0; n < cell->config->num_irqchips; n++, irqchip++) {
@@ -753,6 +863,13 @@ int iommu_map_memory_region(struct cell *cell,
 	unsigned long access_flags = 0;
 	unsigned long paging_flags = PAGING_COHERENT | PAGING_HUGE;
 
+	if (cell->arch.vtd.ept_shared) {
+		/* the EPT update already created the mapping */
+		if (dmar_caching_mode)
+			iommu_queue_flush(cell, mem->virt_start, mem->size);
+		return 0;
+	}
+
 	if (!(mem->flags & JAILHOUSE_MEM_DMA))
 		return 0;
 
@@ -766,6 +883,10 @@ int iommu_map_memory_region(struct cell *cell,
 	if (mem->flags & JAILHOUSE_MEM_NO_HUGEPAGES)
 		paging_flags &= ~PAGING_HUGE;
 
+	/* in caching mode, even non-present entries may be cached */
+	if (dmar_caching_mode)
+		iommu_queue_flush(cell, mem->virt_start, mem->size);
+
 	return paging_create(&cell->arch.vtd.pg_structs, mem->phys_start,
 			     mem->size, mem->virt_start, access_flags,
 			     paging_flags);
@@ -774,9 +895,17 @@ int iommu_map_memory_region(struct cell *cell,
 int iommu_unmap_memory_region(struct cell *cell,
 			      const struct jailhouse_memory *mem)
 {
+	/* the EPT update removed the mapping, regardless of the DMA flag */
+	if (cell->arch.vtd.ept_shared) {
+		iommu_queue_flush(cell, mem->virt_start, mem->size);
+		return 0;
+	}
+
 	if (!(mem->flags & JAILHOUSE_MEM_DMA))
 		return 0;
 
+	iommu_queue_flush(cell, mem->virt_start, mem->size);
+
 	return paging_destroy(&cell->arch.vtd.pg_structs, mem->virt_start,
 			      mem->size, PAGING_COHERENT);
 }
@@ -826,7 +955,8 @@ iommu_get_remapped_root_int(unsigned int iommu, u16 device_id,
 int iommu_map_interrupt(struct cell *cell, u16 device_id, unsigned int vector,
 			struct apic_irq_message irq_msg)
 {
-	union vtd_irte irte;
+	struct vtd_inv_batch batch = { .count = 0 };
+	union vtd_irte irte, *current_irte;
 	int base_index;
 
 	base_index = vtd_find_int_remap_region(device_id);
@@ -869,14 +999,24 @@ int iommu_map_interrupt(struct cell *cell, u16 device_id, unsigned int vector,
 	irte.field.svt = VTD_IRTE_SVT_VERIFY_SID_SQ;
 
 update_irte:
-	vtd_update_irte(base_index + vector, irte);
+	/*
+	 * Guests frequently rewrite unchanged vectors. The cached entry then
+	 * still matches, so the update and its invalidation can be skipped.
+	 */
+	current_irte = &int_remap_table[base_index + vector];
+	if (irte.raw[0] != current_irte->raw[0] ||
+	    irte.raw[1] != current_irte->raw[1]) {
+		vtd_update_irte(&batch, base_index + vector, irte);
+		vtd_inv_batch_submit(&batch);
+	}
 
 	return base_index + vector;
 }
 
 static void vtd_cell_exit(struct cell *cell)
 {
-	page_free(&mem_pool, cell->arch.vtd.pg_structs.root_table, 1);
+	if (!cell->arch.vtd.ept_shared)
+		page_free(&mem_pool, cell->arch.vtd.pg_structs.root_table, 1);
 
 	/*
 	 * Note that reservation regions of IOAPICs won't be released because
@@ -886,6 +1026,7 @@ static void vtd_cell_exit(struct cell *cell)
 
 void iommu_config_commit(struct cell *cell_added_removed)
 {
+	struct vtd_inv_batch batch = { .count = 0 };
 	void *inv_queue = unit_inv_queue;
 	void *reg_base = dmar_reg_base;
 	unsigned int n;
@@ -900,10 +1041,16 @@ void iommu_config_commit(struct cell *cell_added_removed)
 			inv_queue += PAGE_SIZE;
 		}
 		dmar_units_initialized = true;
+		/* covered by the global invalidations of the units */
+		iommu_reset_flush_queue(&root_cell);
 	} else {
-		if (cell_added_removed)
-			vtd_flush_domain_caches(cell_added_removed->config->id);
-		vtd_flush_domain_caches(root_cell.config->id);
+		if (cell_added_removed) {
+			/* the cell's devices were attached or detached */
+			iommu_queue_flush_all(cell_added_removed);
+			vtd_flush_domain_caches(&batch, cell_added_removed);
+		}
+		vtd_flush_domain_caches(&batch, &root_cell);
+		vtd_inv_batch_submit(&batch);
 	}
 }
 
@@ -987,11 +1134,13 @@ static int vtd_init_ir_emulation(unsigned int unit_no, void *reg_base)
 
 static int vtd_init(void)
 {
-	unsigned long version, caps, ecaps, ctrls, sllps_caps = ~0UL;
+	unsigned long version, caps, ecaps, ctrls, common_caps = ~0UL;
+	unsigned long common_ecaps = ~0UL;
+	const struct paging *ept_paging;
 	unsigned int units, pt_levels, num_did, n;
 	struct jailhouse_iommu *unit;
+	int err, psi_max_order;
 	void *reg_base;
-	int err;
 
 	/* n = roundup(log2(VTD_INTERRUPT_LIMIT())) */
 	for (n = 0; (1UL << n) < VTD_INTERRUPT_LIMIT(); n++)
@@ -1045,7 +1194,7 @@ static int vtd_init(void)
 			pt_levels = 4;
 		else
 			return trace_error(-EIO);
-		sllps_caps &= caps;
+		common_caps &= caps;
 
 		if (dmar_pt_levels > 0 && dmar_pt_levels != pt_levels)
 			return trace_error(-EIO);
@@ -1055,6 +1204,7 @@ static int vtd_init(void)
 		if (!(ecaps & VTD_ECAP_QI) || !(ecaps & VTD_ECAP_IR) ||
 		    (using_x2apic && !(ecaps & VTD_ECAP_EIM)))
 			return trace_error(-EIO);
+		common_ecaps &= ecaps;
 
 		ctrls = mmio_read32(reg_base + VTD_GSTS_REG) &
 			VTD_GSTS_USED_CTRLS;
@@ -1072,10 +1222,28 @@ static int vtd_init(void)
 		num_did = 1 << (4 + (caps & VTD_CAP_NUM_DID_MASK) * 2);
 		if (num_did < dmar_num_did)
 			dmar_num_did = num_did;
+
+		psi_max_order = -1;
+		if (caps & VTD_CAP_PSI)
+			psi_max_order = (caps & VTD_CAP_MAMV_MASK) >>
+				VTD_CAP_MAMV_SHIFT;
+		if (psi_max_order < dmar_psi_max_order)
+			dmar_psi_max_order = psi_max_order;
+		if (caps & VTD_CAP_CM)
+			dmar_caching_mode = true;
 	}
 
 	dmar_units = units;
 
+	/*
+	 * The EPT always has 4 levels and is updated without flushing CPU
+	 * caches, so sharing it requires 48-bit AGAW and coherent walks.
+	 */
+	dmar_ept_sharing = (common_caps & VTD_CAP_SAGAW48) &&
+		(common_ecaps & VTD_ECAP_C);
+	if (dmar_ept_sharing)
+		dmar_pt_levels = 4;
+
 	/*
 	 * Derive vdt_paging from very similar x86_64_paging,
 	 * replicating 0..3 for 4 levels and 1..3 for 3 levels.
@@ -1084,11 +1252,19 @@ static int vtd_init(void)
 	       sizeof(struct paging) * dmar_pt_levels);
 	for (n = 0; n < dmar_pt_levels; n++)
 		vtd_paging[n].set_next_pt = vtd_set_next_pt;
-	if (!(sllps_caps & VTD_CAP_SLLPS1G))
+	if (!(common_caps & VTD_CAP_SLLPS1G))
 		vtd_paging[dmar_pt_levels - 3].page_size = 0;
-	if (!(sllps_caps & VTD_CAP_SLLPS2M))
+	if (!(common_caps & VTD_CAP_SLLPS2M))
 		vtd_paging[dmar_pt_levels - 2].page_size = 0;
 
+	/* huge pages of the EPT must be understood by all units */
+	ept_paging = arch_paging_cell_structs(&root_cell)->root_paging;
+	for (n = 0; n < dmar_pt_levels && dmar_ept_sharing; n++)
+		if (ept_paging[n].page_size > vtd_paging[n].page_size)
+			dmar_ept_sharing = false;
+	if (dmar_ept_sharing)
+		printk("DMAR: EPT can be shared as page tables\n");
+
 	return vtd_cell_init(&root_cell);
 }
 
@@ -377,6 +377,7 @@ static void cell_destroy_internal(struct cell *cell)
 		public_per_cpu(cpu)->failed = false;
 		memset(public_per_cpu(cpu)->stats, 0,
 		       sizeof(public_per_cpu(cpu)->stats));
+		mmio_cache_invalidate(&public_per_cpu(cpu)->mmio_cache);
 	}
 
 	for_each_mem_region(mem, cell->config, n) {
@@ -492,6 +493,12 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 	if (err)
 		goto err_cell_exit;
 
+	/*
+	 * Collect the MMIO regions registered while setting up the cell and
+	 * commit them at once afterwards.
+	 */
+	mmio_region_batch_begin(cell);
+
 	for_each_unit(unit) {
 		err = unit->cell_init(cell);
 		if (err) {
@@ -503,7 +510,8 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 
 	/*
 	 * Shrinking: the new cell's CPUs are parked, then removed from the root
-	 * cell, assigned to the new cell and get their stats cleared.
+	 * cell, assigned to the new cell and get their stats and MMIO region
+	 * caches cleared.
 	 */
 	for_each_cpu(cpu, cell->cpu_set) {
 		arch_park_cpu(cpu);
@@ -512,6 +520,7 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 		public_per_cpu(cpu)->cell = cell;
 		memset(public_per_cpu(cpu)->stats, 0,
 		       sizeof(public_per_cpu(cpu)->stats));
+		mmio_cache_invalidate(&public_per_cpu(cpu)->mmio_cache);
 	}
 
 	/*
@@ -539,6 +548,8 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 			goto err_destroy_cell;
 	}
 
+	mmio_region_batch_commit(cell);
+
 	config_commit(cell);
 
 	cell->comm_page.comm_region.cell_state = JAILHOUSE_CELL_SHUT_DOWN;
@@ -737,6 +748,12 @@ static int cell_destroy(struct per_cpu *cpu_data, unsigned long id)
 
 	printk("Closing cell \"%s\"\n", cell->config->name);
 
+	/*
+	 * Do not scrub the released memory while the root cell is suspended.
+	 * It is cleaned up on reallocation or by later hypercalls.
+	 */
+	page_pool_defer_scrubbing(&mem_pool, true);
+
 	cell_destroy_internal(cell);
 
 	previous = &root_cell;
@@ -746,6 +763,7 @@ static int cell_destroy(struct per_cpu *cpu_data, unsigned long id)
 	num_cells--;
 
 	page_free(&mem_pool, cell, cell->data_pages);
+	page_pool_defer_scrubbing(&mem_pool, false);
 	paging_dump_stats("after cell destruction");
 
 	cell_reconfig_completed();
@@ -889,11 +907,15 @@ static long hypervisor_get_info(struct per_cpu *cpu_data, unsigned long type)
 	case JAILHOUSE_INFO_MEM_POOL_SIZE:
 		return mem_pool.pages;
 	case JAILHOUSE_INFO_MEM_POOL_USED:
-		return mem_pool.used_pages;
+		return mem_pool_used_pages();
 	case JAILHOUSE_INFO_REMAP_POOL_SIZE:
 		return remap_pool.pages;
 	case JAILHOUSE_INFO_REMAP_POOL_USED:
 		return remap_pool.used_pages;
+	case JAILHOUSE_INFO_MEM_POOL_DIRTY:
+		return mem_pool.dirty_pages;
+	case JAILHOUSE_INFO_MEM_POOL_CACHED:
+		return mem_pool_cached_pages();
 	case JAILHOUSE_INFO_NUM_CELLS:
 		return num_cells;
 	default:
@@ -923,6 +945,11 @@ static int cpu_get_info(struct per_cpu *cpu_data, unsigned long cpu_id,
 		type - JAILHOUSE_CPU_INFO_STAT_BASE < JAILHOUSE_NUM_CPU_STATS) {
 		type -= JAILHOUSE_CPU_INFO_STAT_BASE;
 		return public_per_cpu(cpu_id)->stats[type] & BIT_MASK(30, 0);
+	} else if (type >= JAILHOUSE_CPU_INFO_ARCH_BASE) {
+		/* may involve other CPUs, thus reserved to the root cell */
+		if (cpu_data->public.cell != &root_cell)
+			return -EPERM;
+		return arch_cpu_get_info(cpu_id, type);
 	} else
 		return -EINVAL;
 }
@@ -943,6 +970,10 @@ long hypercall(unsigned long code, unsigned long arg1, unsigned long arg2)
 
 	cpu_data->public.stats[JAILHOUSE_CPU_STAT_VMEXITS_HYPERCALL]++;
 
+	/* Only the root cell pays for the cleanup of destroyed cells. */
+	if (cpu_data->public.cell == &root_cell)
+		page_pool_scrub_dirty(&mem_pool);
+
 	switch (code) {
 	case JAILHOUSE_HC_DISABLE:
 		return hypervisor_disable(cpu_data);
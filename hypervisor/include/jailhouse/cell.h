@@ -55,8 +55,8 @@ struct cell {
 	/** List of PCI devices assigned to this cell. */
 	struct pci_device *pci_devices;
 
-	/** Lock protecting changes to mmio_locations, mmio_handlers, and
-	 * num_mmio_regions. */
+	/** Lock protecting changes to mmio_locations, mmio_handlers,
+	 * num_mmio_regions, and the registration batch state. */
 	spinlock_t mmio_region_lock;
 	/** Generation counter of mmio_locations, mmio_handlers, and
 	 * num_mmio_regions. */
@@ -69,6 +69,12 @@ struct cell {
 	unsigned int num_mmio_regions;
 	/** Maximum number of MMIO regions. */
 	unsigned int max_mmio_regions;
+	/** Number of regions queued behind the visible ones while a
+	 * registration batch is open. */
+	unsigned int num_pending_mmio_regions;
+	/** True while a registration batch is open, see
+	 * mmio_region_batch_begin(). */
+	bool mmio_batch_open;
 };
 
 extern struct cell root_cell;
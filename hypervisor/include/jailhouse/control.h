@@ -266,6 +266,16 @@ void arch_cell_reset(struct cell *cell);
  */
 void arch_config_commit(struct cell *cell_added_removed);
 
+/**
+ * Retrieves architecture-specific information about a CPU.
+ * @param cpu_id	ID of the CPU.
+ * @param type		Information type, at least
+ * 			JAILHOUSE_CPU_INFO_ARCH_BASE.
+ *
+ * @return Requested information or negative error code.
+ */
+int arch_cpu_get_info(unsigned int cpu_id, unsigned long type);
+
 /**
  * Architecture-specific preparations before shutting down the hypervisor.
  */
@@ -174,6 +174,23 @@ struct mmio_region_handler {
 	void *arg;
 };
 
+/** Number of entries in the per-CPU MMIO region cache. */
+#define MMIO_CACHE_ENTRIES	4
+
+/** Per-CPU cache of recently dispatched MMIO regions. */
+struct mmio_region_cache {
+	/** Value of cell::mmio_generation the entries are valid for. */
+	unsigned long generation;
+	/** Number of valid entries. */
+	unsigned int num_entries;
+	/** Next entry to be replaced once the cache is full. */
+	unsigned int next_victim;
+	/** Locations of the cached regions. */
+	struct mmio_region_location locations[MMIO_CACHE_ENTRIES];
+	/** Handlers of the cached regions. */
+	struct mmio_region_handler handlers[MMIO_CACHE_ENTRIES];
+};
+
 int mmio_cell_init(struct cell *cell);
 
 void mmio_region_register(struct cell *cell, unsigned long start,
@@ -181,8 +198,22 @@ void mmio_region_register(struct cell *cell, unsigned long start,
 			  void *handler_arg);
 void mmio_region_unregister(struct cell *cell, unsigned long start);
 
+void mmio_region_batch_begin(struct cell *cell);
+void mmio_region_batch_commit(struct cell *cell);
+
 enum mmio_result mmio_handle_access(struct mmio_access *mmio);
 
+/**
+ * Invalidate the MMIO region cache of a CPU.
+ * @param cache		Cache to invalidate.
+ *
+ * @note Must be called whenever the CPU is assigned to a different cell.
+ */
+static inline void mmio_cache_invalidate(struct mmio_region_cache *cache)
+{
+	cache->num_entries = 0;
+}
+
 void mmio_cell_exit(struct cell *cell);
 
 void mmio_perform_access(void *base, struct mmio_access *mmio);
@@ -36,9 +36,11 @@
 /** Count number of pages for given size (round up). */
 #define PAGES(s)		(((s) + PAGE_SIZE-1) / PAGE_SIZE)
 
+/** Location of per-CPU mapping of an ivshmem state table. */
+#define STATE_TABLE_MAPPING_BASE	(TEMPORARY_MAPPING_BASE + \
+					 NUM_TEMPORARY_PAGES * PAGE_SIZE)
 /** Location of per-CPU data structure in hypervisor address space. */
-#define LOCAL_CPU_BASE		(TEMPORARY_MAPPING_BASE + \
-				 NUM_TEMPORARY_PAGES * PAGE_SIZE)
+#define LOCAL_CPU_BASE		(STATE_TABLE_MAPPING_BASE + PAGE_SIZE)
 /** @} */
 
 #include <asm/paging.h>
@@ -47,6 +49,7 @@
 
 #include <jailhouse/entry.h>
 #include <jailhouse/types.h>
+#include <asm/spinlock.h>
 
 /**
  * @ingroup Paging
@@ -56,6 +59,21 @@
 /** Global page pool */
 extern u8 __page_pool[];
 
+/** Maximum number of block orders a page pool can manage. */
+#define PAGE_POOL_MAX_ORDERS	24
+
+/** Free blocks of a specific order (size 2^order pages) in a page pool. */
+struct page_pool_order {
+	/** Bitmap of free blocks, one bit per naturally aligned block. */
+	unsigned long *free_bitmap;
+	/** One bit per free_bitmap word, set if that word is non-zero. */
+	unsigned long *free_summary;
+	/** Number of blocks of this order spanning the pool. */
+	unsigned long blocks;
+	/** Number of currently free blocks of this order. */
+	unsigned long free_blocks;
+};
+
 /** Page pool state. */
 struct page_pool {
 	/** Base address of the pool. */
@@ -64,10 +82,35 @@ struct page_pool {
 	unsigned long pages;
 	/** Number of currently used pages. */
 	unsigned long used_pages;
-	/** Base address for bitmap of used pages. */
-	unsigned long *used_bitmap;
+	/** Offset applied to page numbers so that blocks are naturally aligned
+	 * in the address space. */
+	unsigned long block_bias;
+	/** Number of block orders in use. */
+	unsigned int num_orders;
+	/** Free block tracking of the buddy allocator, per order. */
+	struct page_pool_order orders[PAGE_POOL_MAX_ORDERS];
+	/** Free pages whose scrubbing was deferred, one bit per page. Only
+	 * present if @c PAGE_SCRUB_ON_FREE is set. */
+	unsigned long *dirty_bitmap;
+	/** Number of free pages whose scrubbing was deferred. */
+	unsigned long dirty_pages;
 	/** Set @c PAGE_SCRUB_ON_FREE to zero-out pages on release. */
 	unsigned long flags;
+	/** Serializes allocations and releases. */
+	spinlock_t lock;
+};
+
+/** Number of single pages a per-CPU page magazine can hold. */
+#define PAGE_MAGAZINE_SIZE	16
+/** Number of pages moved between a magazine and mem_pool at once. */
+#define PAGE_MAGAZINE_BATCH	(PAGE_MAGAZINE_SIZE / 2)
+
+/** Per-CPU cache of free page table pages taken from mem_pool. */
+struct page_magazine {
+	/** Number of cached pages. */
+	unsigned int count;
+	/** Cached pages, all zeroed. */
+	void *pages[PAGE_MAGAZINE_SIZE];
 };
 
 /**
@@ -214,6 +257,11 @@ unsigned long paging_get_phys_invalid(pt_entry_t pte, unsigned long virt);
 void *page_alloc(struct page_pool *pool, unsigned int num);
 void *page_alloc_aligned(struct page_pool *pool, unsigned int num);
 void page_free(struct page_pool *pool, void *first_page, unsigned int num);
+void page_pool_defer_scrubbing(struct page_pool *pool, bool defer);
+void page_pool_scrub_dirty(struct page_pool *pool);
+unsigned long mem_pool_used_pages(void);
+unsigned long mem_pool_cached_pages(void);
+void paging_enable_page_magazines(void);
 
 /**
  * Translate virtual hypervisor address to physical address.
@@ -263,12 +311,30 @@ unsigned long paging_virt2phys(const struct paging_structures *pg_structs,
  */
 unsigned long arch_paging_gphys2phys(unsigned long gphys, unsigned long flags);
 
+/**
+ * Get the paging structures translating guest-physical addresses of a cell.
+ * @param cell		Cell to query.
+ *
+ * @return Descriptor of the cell's guest-physical paging structures.
+ */
+const struct paging_structures *arch_paging_cell_structs(struct cell *cell);
+
+/**
+ * Check if the IOMMU translates DMA requests of a cell via the paging
+ * structures returned by arch_paging_cell_structs().
+ * @param cell		Cell to query.
+ *
+ * @return True if no separate IOMMU page tables exist for the cell.
+ */
+bool arch_paging_cell_structs_shared(struct cell *cell);
+
 int paging_create(const struct paging_structures *pg_structs,
 		  unsigned long phys, unsigned long size, unsigned long virt,
 		  unsigned long access_flags, unsigned long paging_flags);
 int paging_destroy(const struct paging_structures *pg_structs,
 		   unsigned long virt, unsigned long size,
 		   unsigned long paging_flags);
+unsigned long paging_get_guest_invalidations(void);
 
 void *paging_map_device(unsigned long phys, unsigned long size);
 void paging_unmap_device(unsigned long phys, void *virt, unsigned long size);
@@ -42,6 +42,14 @@ struct public_per_cpu {
 	/** Statistic counters. */
 	u32 stats[JAILHOUSE_NUM_CPU_STATS];
 
+	/** Recently dispatched MMIO regions of the owning cell. Public
+	 *  because it has to be invalidated when the CPU changes its cell. */
+	struct mmio_region_cache mmio_cache;
+
+	/** Free page table pages cached for this CPU. Public because the
+	 *  cached pages have to be excluded from the pool usage. */
+	struct page_magazine page_magazine;
+
 	/** State of the shutdown process. Possible values:
 	 * @li SHUTDOWN_NONE: no shutdown in progress
 	 * @li SHUTDOWN_STARTED: shutdown in progress
@@ -78,6 +86,9 @@ struct per_cpu {
 
 	/** Per-CPU paging structures. */
 	struct paging_structures pg_structs;
+	/** Physical address of the ivshmem state table currently mapped at
+	 *  STATE_TABLE_MAPPING_BASE, or INVALID_PHYS_ADDR. */
+	unsigned long state_table_phys;
 
 	ARCH_PERCPU_FIELDS;
 
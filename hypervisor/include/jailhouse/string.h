@@ -13,6 +13,7 @@
  * the COPYING file in the top-level directory.
  */
 #include <jailhouse/types.h>
+#include <asm/string.h>
 
 void *memcpy(void *d, const void *s, size_t n);
 void *memset(void *s, int c, size_t n);
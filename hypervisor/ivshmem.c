@@ -101,22 +101,33 @@ static void ivshmem_trigger_interrupt(struct ivshmem_endpoint *ive,
 	spin_unlock(&ive->irq_lock);
 }
 
+/*
+ * Map the first page of the state table into the private mapping page of the
+ * calling CPU. The mapping is only replaced when a different state table is
+ * written. A mapping left behind by a destroyed link still targets the page it
+ * was created for, so no other CPU has to flush its TLB when links go away.
+ */
 static u32 *ivshmem_map_state_table(struct ivshmem_endpoint *ive)
 {
-	/*
-	 * Cannot fail: upper levels of page table were already created by
-	 * paging_init, and we always map single pages, thus only update the
-	 * leaf entry and do not have to deal with huge pages.
-	 */
-	paging_create(&this_cpu_data()->pg_structs,
-		      ive->shmem[0].phys_start, PAGE_SIZE,
-		      TEMPORARY_MAPPING_BASE, PAGE_DEFAULT_FLAGS,
-		      PAGING_NON_COHERENT | PAGING_NO_HUGE);
+	struct per_cpu *cpu_data = this_cpu_data();
+	unsigned long phys = ive->shmem[0].phys_start;
+
+	if (cpu_data->state_table_phys != phys) {
+		/*
+		 * Cannot fail: upper levels of page table were already
+		 * created by cpu_init, and we always map single pages, thus
+		 * only update the leaf entry and do not have to deal with huge
+		 * pages.
+		 */
+		paging_create(&cpu_data->pg_structs, phys, PAGE_SIZE,
+			      STATE_TABLE_MAPPING_BASE, PAGE_DEFAULT_FLAGS,
+			      PAGING_NON_COHERENT | PAGING_NO_HUGE);
+		cpu_data->state_table_phys = phys;
+	}
 
-	return (u32 *)TEMPORARY_MAPPING_BASE;
+	return (u32 *)STATE_TABLE_MAPPING_BASE;
 }
 
-
 static void ivshmem_write_state(struct ivshmem_endpoint *ive, u32 new_state)
 {
 	const struct jailhouse_pci_device *dev_info = ive->device->info;
@@ -12,6 +12,7 @@
 
 #include <jailhouse/string.h>
 
+#ifndef ARCH_HAS_MEMSET
 void *memset(void *s, int c, size_t n)
 {
 	u8 *p = s;
@@ -20,6 +21,7 @@ void *memset(void *s, int c, size_t n)
 		*p++ = c;
 	return s;
 }
+#endif
 
 int strcmp(const char *s1, const char *s2)
 {
@@ -32,6 +34,7 @@ int strcmp(const char *s1, const char *s2)
 	return *(unsigned char *)s1 - *(unsigned char *)s2;
 }
 
+#ifndef ARCH_HAS_MEMCPY
 void *memcpy(void *dest, const void *src, size_t n)
 {
 	const u8 *s = src;
@@ -41,3 +44,4 @@ void *memcpy(void *dest, const void *src, size_t n)
 		*d++ = *s++;
 	return dest;
 }
+#endif
@@ -61,6 +61,16 @@ static void copy_region(struct cell *cell, unsigned int src, unsigned dst)
 	cell->mmio_handlers[dst] = cell->mmio_handlers[src];
 }
 
+static void set_region(struct cell *cell, unsigned int index,
+		       unsigned long start, unsigned long size,
+		       mmio_handler handler, void *handler_arg)
+{
+	cell->mmio_locations[index].start = start;
+	cell->mmio_locations[index].size = size;
+	cell->mmio_handlers[index].function = handler;
+	cell->mmio_handlers[index].arg = handler_arg;
+}
+
 /**
  * Register a MMIO region access handler for a cell.
  * @param cell		Cell than can access the region.
@@ -69,7 +79,11 @@ static void copy_region(struct cell *cell, unsigned int src, unsigned dst)
  * @param handler	Access handler.
  * @param handler_arg	Opaque argument to pass to handler.
  *
+ * If a registration batch is open for the cell, the region is only queued and
+ * becomes visible on mmio_region_batch_commit().
+ *
  * @see mmio_region_unregister
+ * @see mmio_region_batch_begin
  */
 void mmio_region_register(struct cell *cell, unsigned long start,
 			  unsigned long size, mmio_handler handler,
@@ -79,13 +93,29 @@ void mmio_region_register(struct cell *cell, unsigned long start,
 
 	spin_lock(&cell->mmio_region_lock);
 
-	if (cell->num_mmio_regions >= cell->max_mmio_regions) {
+	if (cell->num_mmio_regions + cell->num_pending_mmio_regions >=
+	    cell->max_mmio_regions) {
 		spin_unlock(&cell->mmio_region_lock);
 
 		printk("WARNING: Overflow during MMIO region registration!\n");
 		return;
 	}
 
+	/*
+	 * Pending regions are appended behind the visible ones. Lookups do not
+	 * consider them before the batch is committed, so there is no need to
+	 * advance the generation.
+	 */
+	if (cell->mmio_batch_open) {
+		set_region(cell, cell->num_mmio_regions +
+			   cell->num_pending_mmio_regions,
+			   start, size, handler, handler_arg);
+		cell->num_pending_mmio_regions++;
+
+		spin_unlock(&cell->mmio_region_lock);
+		return;
+	}
+
 	for (index = 0; index < cell->num_mmio_regions; index++)
 		if (cell->mmio_locations[index].start > start)
 			break;
@@ -101,10 +131,7 @@ void mmio_region_register(struct cell *cell, unsigned long start,
 	for (n = cell->num_mmio_regions; n > index; n--)
 		copy_region(cell, n - 1, n);
 
-	cell->mmio_locations[index].start = start;
-	cell->mmio_locations[index].size = size;
-	cell->mmio_handlers[index].function = handler;
-	cell->mmio_handlers[index].arg = handler_arg;
+	set_region(cell, index, start, size, handler, handler_arg);
 
 	cell->num_mmio_regions++;
 
@@ -115,8 +142,98 @@ void mmio_region_register(struct cell *cell, unsigned long start,
 	spin_unlock(&cell->mmio_region_lock);
 }
 
+/**
+ * Open a batch of MMIO region registrations for a cell.
+ * @param cell		Cell to register regions for.
+ *
+ * Subsequent calls to mmio_region_register() for this cell only queue the
+ * regions. The queue is sorted into the region table at once by
+ * mmio_region_batch_commit(). This avoids shifting the table on each
+ * registration when setting up cells with many regions.
+ *
+ * @see mmio_region_batch_commit
+ */
+void mmio_region_batch_begin(struct cell *cell)
+{
+	spin_lock(&cell->mmio_region_lock);
+	cell->mmio_batch_open = true;
+	spin_unlock(&cell->mmio_region_lock);
+}
+
+static void swap_regions(struct cell *cell, unsigned int a, unsigned int b)
+{
+	struct mmio_region_location location = cell->mmio_locations[a];
+	struct mmio_region_handler handler = cell->mmio_handlers[a];
+
+	copy_region(cell, b, a);
+	cell->mmio_locations[b] = location;
+	cell->mmio_handlers[b] = handler;
+}
+
+static void sift_down_region(struct cell *cell, unsigned int root,
+			     unsigned int end)
+{
+	struct mmio_region_location *locations = cell->mmio_locations;
+	unsigned int child;
+
+	while ((child = 2 * root + 1) < end) {
+		if (child + 1 < end &&
+		    locations[child].start < locations[child + 1].start)
+			child++;
+		if (locations[root].start >= locations[child].start)
+			break;
+		swap_regions(cell, root, child);
+		root = child;
+	}
+}
+
+/* Heapsort, so that we neither recurse nor need additional memory. */
+static void sort_regions(struct cell *cell)
+{
+	unsigned int n;
+
+	for (n = cell->num_mmio_regions / 2; n > 0; n--)
+		sift_down_region(cell, n - 1, cell->num_mmio_regions);
+
+	for (n = cell->num_mmio_regions; n > 1; n--) {
+		swap_regions(cell, 0, n - 1);
+		sift_down_region(cell, 0, n - 1);
+	}
+}
+
+/**
+ * Commit a batch of MMIO region registrations.
+ * @param cell		Cell the batch was opened for.
+ *
+ * All regions queued since mmio_region_batch_begin() become visible to the
+ * MMIO dispatcher at once.
+ *
+ * @see mmio_region_batch_begin
+ */
+void mmio_region_batch_commit(struct cell *cell)
+{
+	spin_lock(&cell->mmio_region_lock);
+
+	if (cell->num_pending_mmio_regions > 0) {
+		/* see mmio_region_register for the generation protocol */
+		cell->mmio_generation++;
+		memory_barrier();
+
+		cell->num_mmio_regions += cell->num_pending_mmio_regions;
+		cell->num_pending_mmio_regions = 0;
+		sort_regions(cell);
+
+		memory_barrier();
+		cell->mmio_generation++;
+	}
+	cell->mmio_batch_open = false;
+
+	spin_unlock(&cell->mmio_region_lock);
+}
+
 static int find_region(struct cell *cell, unsigned long address,
-		       unsigned int size, unsigned long *region_base,
+		       unsigned int size, unsigned long *generation_ptr,
+		       struct mmio_region_location *location,
 		       struct mmio_region_handler *handler)
 {
 	unsigned int range_start, range_size, index;
@@ -164,8 +281,9 @@ restart:
 			range_size -= index + 1 - range_start;
 			range_start = index + 1;
 		} else {
-			if (region_base != NULL) {
-				*region_base = region.start;
+			if (location != NULL) {
+				*generation_ptr = generation;
+				*location = region;
 				*handler = cell->mmio_handlers[index];
 			}
 
@@ -195,11 +313,14 @@ restart:
  */
 void mmio_region_unregister(struct cell *cell, unsigned long start)
 {
+	unsigned int num_regions, n;
 	int index;
 
 	spin_lock(&cell->mmio_region_lock);
 
-	index = find_region(cell, start, 1, NULL, NULL);
+	num_regions = cell->num_mmio_regions + cell->num_pending_mmio_regions;
+
+	index = find_region(cell, start, 1, NULL, NULL, NULL);
 	if (index >= 0) {
 		/*
 		 * Advance the generation to odd value, indicating that
@@ -209,7 +330,8 @@ void mmio_region_unregister(struct cell *cell, unsigned long start)
 		cell->mmio_generation++;
 		memory_barrier();
 
-		for (/* empty */; (u32)index < cell->num_mmio_regions; index++)
+		/* This also moves pending regions along. */
+		for (/* empty */; (u32)index + 1 < num_regions; index++)
 			copy_region(cell, index + 1, index);
 
 		cell->num_mmio_regions--;
@@ -220,16 +342,75 @@ void mmio_region_unregister(struct cell *cell, unsigned long start)
 		 */
 		memory_barrier();
 		cell->mmio_generation++;
+	} else {
+		/* Pending regions are invisible, no generation update needed. */
+		for (n = cell->num_mmio_regions; n < num_regions; n++)
+			if (start >= cell->mmio_locations[n].start &&
+			    start < cell->mmio_locations[n].start +
+				    cell->mmio_locations[n].size)
+				break;
+		if (n < num_regions) {
+			for (/* empty */; n + 1 < num_regions; n++)
+				copy_region(cell, n + 1, n);
+			cell->num_pending_mmio_regions--;
+		}
 	}
 	spin_unlock(&cell->mmio_region_lock);
 }
 
+static int cache_lookup(struct mmio_region_cache *cache,
+			unsigned long generation, unsigned long address,
+			unsigned int size)
+{
+	unsigned int n;
+
+	if (cache->generation != generation)
+		return -1;
+
+	for (n = 0; n < cache->num_entries; n++)
+		if (address >= cache->locations[n].start &&
+		    address + size <= cache->locations[n].start +
+				      cache->locations[n].size)
+			return n;
+
+	return -1;
+}
+
+static void cache_insert(struct mmio_region_cache *cache,
+			 unsigned long generation,
+			 const struct mmio_region_location *location,
+			 const struct mmio_region_handler *handler)
+{
+	unsigned int index;
+
+	if (cache->generation != generation) {
+		cache->generation = generation;
+		cache->num_entries = 0;
+		cache->next_victim = 0;
+	}
+
+	if (cache->num_entries < MMIO_CACHE_ENTRIES) {
+		index = cache->num_entries++;
+	} else {
+		index = cache->next_victim;
+		cache->next_victim = (index + 1) % MMIO_CACHE_ENTRIES;
+	}
+
+	cache->locations[index] = *location;
+	cache->handlers[index] = *handler;
+}
+
 /**
  * Dispatch MMIO access of a cell CPU.
  * @param mmio		MMIO access description. @a mmio->value will receive the
  * 			result of a successful read access. All @a mmio fields
  * 			may have been modified on return.
  *
+ * Regions that were recently dispatched on the calling CPU are looked up in
+ * its MMIO region cache first. The cache is valid as long as the cell's
+ * mmio_generation does not change, i.e. no region was (un)registered
+ * meanwhile.
+ *
  * @return MMIO_HANDLED on success, MMIO_UNHANDLED if no region is registered
  * for the access address and size, or MMIO_ERROR if an access error was
  * detected.
@@ -239,14 +420,36 @@ void mmio_region_unregister(struct cell *cell, unsigned long start)
  */
 enum mmio_result mmio_handle_access(struct mmio_access *mmio)
 {
+	struct public_per_cpu *cpu_public = this_cpu_public();
+	struct mmio_region_cache *cache = &cpu_public->mmio_cache;
+	struct cell *cell = cpu_public->cell;
+	struct mmio_region_location location;
 	struct mmio_region_handler handler;
-	unsigned long region_base;
+	unsigned long generation;
+	int index;
 
-	if (find_region(this_cell(), mmio->address, mmio->size, &region_base,
-			&handler) < 0)
-		return MMIO_UNHANDLED;
+	generation = cell->mmio_generation;
+	/* Ensure the generation is read prior to using the cache content. */
+	memory_load_barrier();
+
+	/*
+	 * An odd generation never matches the cache as it is only filled with
+	 * regions looked up under a stable, even generation.
+	 */
+	index = cache_lookup(cache, generation, mmio->address, mmio->size);
+	if (index >= 0) {
+		cpu_public->stats[JAILHOUSE_CPU_STAT_MMIO_CACHE_HITS]++;
+		location = cache->locations[index];
+		handler = cache->handlers[index];
+	} else {
+		cpu_public->stats[JAILHOUSE_CPU_STAT_MMIO_CACHE_MISSES]++;
+		if (find_region(cell, mmio->address, mmio->size, &generation,
+				&location, &handler) < 0)
+			return MMIO_UNHANDLED;
+		cache_insert(cache, generation, &location, &handler);
+	}
 
-	mmio->address -= region_base;
+	mmio->address -= location.start;
 	return handler.function(handler.arg, mmio);
 }
 
@@ -17,9 +17,11 @@
 
 #define BITS_PER_PAGE		(PAGE_SIZE * 8)
 
-#define INVALID_PAGE_NR		(~0UL)
-
 #define PAGE_SCRUB_ON_FREE	0x1
+#define PAGE_SCRUB_DEFERRED	0x2
+
+/* Maximum number of dirty pages scrubbed per page_pool_scrub_dirty() call. */
+#define PAGE_SCRUB_BATCH	16
 
 /**
  * Offset between virtual and physical hypervisor addresses.
@@ -44,6 +46,27 @@ struct paging_structures hv_paging_structs;
 /** Descriptor of paging structures used when parking CPUs. */
 struct paging_structures parking_pt;
 
+/* Set once all CPUs can access their magazines via this_cpu_public(). */
+static bool page_magazines_enabled;
+
+/*
+ * Guest page tables of mem_pool that received mappings created without
+ * PAGING_HUGE, one bit per page. Such tables must not be coalesced.
+ */
+static unsigned long *no_huge_tables;
+
+/* Number of ranged TLB flushes on hypervisor paging structure changes. */
+static unsigned long tlb_flushes;
+
+/* Number of hugepages split up and of page tables coalesced into hugepages. */
+static unsigned long hugepage_splits, hugepage_coalesces;
+
+/*
+ * Number of guest paging structure updates that removed or replaced valid
+ * entries, i.e. that may have left stale translations in CPU TLBs.
+ */
+static unsigned long guest_invalidations;
+
 /**
  * Trivial implementation of paging::get_phys (for non-terminal levels)
  * @param pte See paging::get_phys.
@@ -58,87 +81,240 @@ unsigned long paging_get_phys_invalid(pt_entry_t pte, unsigned long virt)
 	return INVALID_PHYS_ADDR;
 }
 
-static unsigned long find_next_free_page(struct page_pool *pool,
-					 unsigned long start)
+static unsigned int size_to_order(unsigned long num)
 {
-	unsigned long bmp_pos, bmp_val, page_nr;
-	unsigned long start_mask = 0;
+	unsigned int order = 0;
 
-	if (start >= pool->pages)
-		return INVALID_PAGE_NR;
+	while ((1UL << order) < num)
+		order++;
+	return order;
+}
 
-	/*
-	 * If we don't start on the beginning of a bitmap word, create a mask
-	 * to mark the pages before the start page as (virtually) used.
-	 */
-	if (start % BITS_PER_LONG > 0)
-		start_mask = ~0UL >> (BITS_PER_LONG - (start % BITS_PER_LONG));
-
-	for (bmp_pos = start / BITS_PER_LONG;
-	     bmp_pos < pool->pages / BITS_PER_LONG; bmp_pos++) {
-		bmp_val = pool->used_bitmap[bmp_pos] | start_mask;
-		start_mask = 0;
-		if (bmp_val != ~0UL) {
-			page_nr = ffzl(bmp_val) + bmp_pos * BITS_PER_LONG;
-			if (page_nr >= pool->pages)
+static void put_free_block(struct page_pool *pool, unsigned int order,
+			   unsigned long block)
+{
+	struct page_pool_order *pool_order = &pool->orders[order];
+
+	set_bit(block, pool_order->free_bitmap);
+	set_bit(block / BITS_PER_LONG, pool_order->free_summary);
+	pool_order->free_blocks++;
+}
+
+static void take_free_block(struct page_pool *pool, unsigned int order,
+			    unsigned long block)
+{
+	struct page_pool_order *pool_order = &pool->orders[order];
+
+	clear_bit(block, pool_order->free_bitmap);
+	if (pool_order->free_bitmap[block / BITS_PER_LONG] == 0)
+		clear_bit(block / BITS_PER_LONG, pool_order->free_summary);
+	pool_order->free_blocks--;
+}
+
+static bool block_is_free(struct page_pool *pool, unsigned int order,
+			  unsigned long block)
+{
+	struct page_pool_order *pool_order = &pool->orders[order];
+
+	return block < pool_order->blocks &&
+		test_bit(block, pool_order->free_bitmap);
+}
+
+/* Caller has to ensure that a free block of the given order exists. */
+static unsigned long find_free_block(struct page_pool *pool,
+				     unsigned int order)
+{
+	struct page_pool_order *pool_order = &pool->orders[order];
+	unsigned long word, n;
+
+	for (n = 0; pool_order->free_summary[n] == 0; n++)
+		;
+	word = n * BITS_PER_LONG + ffsl(pool_order->free_summary[n]);
+	return word * BITS_PER_LONG + ffsl(pool_order->free_bitmap[word]);
+}
+
+/* Release a free block, merging it with its free buddies. */
+static void release_block(struct page_pool *pool, unsigned int order,
+			  unsigned long block)
+{
+	while (order + 1 < pool->num_orders &&
+	       block_is_free(pool, order, block ^ 1)) {
+		take_free_block(pool, order, block ^ 1);
+		block >>= 1;
+		order++;
+	}
+	put_free_block(pool, order, block);
+}
+
+/* Free a block range by splitting it up into naturally aligned blocks. */
+static void free_block_range(struct page_pool *pool, unsigned long block_start,
+			     unsigned long num)
+{
+	unsigned int order;
+
+	while (num > 0) {
+		for (order = 0; order + 1 < pool->num_orders; order++)
+			if (block_start & (1UL << order) ||
+			    (2UL << order) > num)
 				break;
-			return page_nr;
+
+		release_block(pool, order, block_start >> order);
+
+		block_start += 1UL << order;
+		num -= 1UL << order;
+	}
+}
+
+static void release_pages(struct page_pool *pool, unsigned long page_nr,
+			  unsigned long num)
+{
+	pool->used_pages -= num;
+	free_block_range(pool, page_nr + pool->block_bias, num);
+}
+
+static bool find_containing_block(struct page_pool *pool,
+				  unsigned long block_start,
+				  unsigned int *order, unsigned long *block)
+{
+	for (*order = 0; *order < pool->num_orders; (*order)++) {
+		*block = block_start >> *order;
+		if (block_is_free(pool, *order, *block))
+			return true;
+	}
+	return false;
+}
+
+/* Take a range that is known to be free, splitting the covering blocks. */
+static void take_block_range(struct page_pool *pool, unsigned long block_start,
+			     unsigned long num)
+{
+	unsigned long pos = block_start, end = block_start + num;
+	unsigned long block, first, last;
+	unsigned int order;
+
+	while (pos < end) {
+		if (!find_containing_block(pool, pos, &order, &block))
+			break;
+		take_free_block(pool, order, block);
+
+		first = block << order;
+		last = (block + 1) << order;
+		if (first < pos)
+			free_block_range(pool, first, pos - first);
+		if (last > end)
+			free_block_range(pool, end, last - end);
+		pos = last;
+	}
+}
+
+/*
+ * Slow path for unaligned requests when no sufficiently large block is
+ * available: search for a run of neighboring free blocks.
+ */
+static long find_free_run(struct page_pool *pool, unsigned int num)
+{
+	unsigned long pos = pool->block_bias;
+	unsigned long end = pool->pages + pool->block_bias;
+	unsigned long run_start = pos, block;
+	unsigned int order;
+
+	while (pos < end) {
+		if (!find_containing_block(pool, pos, &order, &block)) {
+			run_start = ++pos;
+			continue;
 		}
+		pos = (block + 1) << order;
+		if (pos - run_start >= num)
+			return run_start;
 	}
+	return -1;
+}
+
+static void scrub_page(struct page_pool *pool, unsigned long page_nr)
+{
+	clear_bit(page_nr, pool->dirty_bitmap);
+	pool->dirty_pages--;
+	memset(pool->base_address + page_nr * PAGE_SIZE, 0, PAGE_SIZE);
+}
+
+/* Scrub pages that were released with deferred scrubbing on reallocation. */
+static void scrub_dirty_range(struct page_pool *pool, unsigned long page_nr,
+			      unsigned long num)
+{
+	if (pool->dirty_pages == 0)
+		return;
 
-	return INVALID_PAGE_NR;
+	for (; num > 0; page_nr++, num--)
+		if (test_bit(page_nr, pool->dirty_bitmap))
+			scrub_page(pool, page_nr);
 }
 
 /**
  * Allocate consecutive pages from the specified pool.
  * @param pool		Page pool to allocate from.
  * @param num		Number of pages.
- * @param align_mask	Choose start so that start_page_no & align_mask == 0.
+ * @param aligned	True if the start has to be aligned to the next power
+ * 			of 2 of @c num.
+ *
+ * The pages are taken from the smallest free buddy block that can hold them.
+ * The block is naturally aligned to its size, i.e. the next power of 2 of @c
+ * num. Pages of the block beyond @c num are returned to the pool immediately.
+ * If no such block is available, unaligned requests fall back to searching
+ * for a run of neighboring free blocks. Aligned requests fail in that case:
+ * free buddies are always merged, so there is no free aligned range either.
  *
  * @return Pointer to first page or NULL if allocation failed.
  *
  * @see page_free
  */
 static void *page_alloc_internal(struct page_pool *pool, unsigned int num,
-				 unsigned long align_mask)
+				 bool aligned)
 {
-	unsigned long aligned_start, pool_start, next, start, last;
-	unsigned int allocated;
-
-	pool_start = (unsigned long)pool->base_address >> PAGE_SHIFT;
-
-	/* The pool itself might not be aligned as required. */
-	aligned_start = ((pool_start + align_mask) & ~align_mask) - pool_start;
-	next = aligned_start;
+	unsigned int order, block_order;
+	unsigned long block, page_nr;
+	long run_start;
 
-restart:
-	/* Forward the search start to the next aligned page. */
-	if ((next - aligned_start) & align_mask)
-		next += num - ((next - aligned_start) & align_mask);
-
-	start = next = find_next_free_page(pool, next);
-	if (start == INVALID_PAGE_NR || num == 0)
+	if (num == 0)
 		return NULL;
 
-	/* Enforce alignment (none of align_mask is 0). */
-	if ((start - aligned_start) & align_mask)
-		goto restart;
+	order = size_to_order(num);
+	for (block_order = order; block_order < pool->num_orders;
+	     block_order++)
+		if (pool->orders[block_order].free_blocks > 0)
+			break;
 
-	for (allocated = 1, last = start; allocated < num;
-	     allocated++, last = next) {
-		next = find_next_free_page(pool, last + 1);
-		if (next == INVALID_PAGE_NR)
+	if (block_order >= pool->num_orders) {
+		if (aligned)
 			return NULL;
-		if (next != last + 1)
-			goto restart;	/* not consecutive */
+		run_start = find_free_run(pool, num);
+		if (run_start < 0)
+			return NULL;
+		take_block_range(pool, run_start, num);
+		pool->used_pages += num;
+		page_nr = run_start - pool->block_bias;
+		goto out;
+	}
+
+	block = find_free_block(pool, block_order);
+	take_free_block(pool, block_order, block);
+
+	/* Split the block, putting the upper halves back into the pool. */
+	while (block_order > order) {
+		block_order--;
+		block <<= 1;
+		put_free_block(pool, block_order, block + 1);
 	}
 
-	for (allocated = 0; allocated < num; allocated++)
-		set_bit(start + allocated, pool->used_bitmap);
+	page_nr = (block << order) - pool->block_bias;
+	pool->used_pages += 1UL << order;
 
-	pool->used_pages += num;
+	if (num < (1UL << order))
+		release_pages(pool, page_nr + num, (1UL << order) - num);
 
-	return pool->base_address + start * PAGE_SIZE;
+out:
+	scrub_dirty_range(pool, page_nr, num);
+
+	return pool->base_address + page_nr * PAGE_SIZE;
 }
 
 /**
@@ -152,7 +328,13 @@ restart:
  */
 void *page_alloc(struct page_pool *pool, unsigned int num)
 {
-	return page_alloc_internal(pool, num, 0);
+	void *pages;
+
+	spin_lock(&pool->lock);
+	pages = page_alloc_internal(pool, num, false);
+	spin_unlock(&pool->lock);
+
+	return pages;
 }
 
 /**
@@ -166,7 +348,13 @@ void *page_alloc(struct page_pool *pool, unsigned int num)
  */
 void *page_alloc_aligned(struct page_pool *pool, unsigned int num)
 {
-	return page_alloc_internal(pool, num, num - 1);
+	void *pages;
+
+	spin_lock(&pool->lock);
+	pages = page_alloc_internal(pool, num, true);
+	spin_unlock(&pool->lock);
+
+	return pages;
 }
 
 /**
@@ -175,23 +363,275 @@ void *page_alloc_aligned(struct page_pool *pool, unsigned int num)
  * @param page	Address of first page.
  * @param num	Number of pages.
  *
+ * @note Any range of previously allocated pages can be released, not only
+ * complete allocations.
+ *
  * @see page_alloc
  */
 void page_free(struct page_pool *pool, void *page, unsigned int num)
 {
 	unsigned long page_nr;
+	unsigned int n;
 
-	if (!page)
+	if (!page || num == 0)
 		return;
 
-	while (num-- > 0) {
-		if (pool->flags & PAGE_SCRUB_ON_FREE)
-			memset(page, 0, PAGE_SIZE);
-		page_nr = (page - pool->base_address) / PAGE_SIZE;
-		clear_bit(page_nr, pool->used_bitmap);
-		pool->used_pages--;
-		page += PAGE_SIZE;
+	page_nr = (page - pool->base_address) / PAGE_SIZE;
+
+	if (pool->flags & PAGE_SCRUB_DEFERRED) {
+		spin_lock(&pool->lock);
+		for (n = 0; n < num; n++)
+			set_bit(page_nr + n, pool->dirty_bitmap);
+		pool->dirty_pages += num;
+		release_pages(pool, page_nr, num);
+		spin_unlock(&pool->lock);
+		return;
+	}
+
+	if (pool->flags & PAGE_SCRUB_ON_FREE)
+		memset(page, 0, (unsigned long)num * PAGE_SIZE);
+
+	spin_lock(&pool->lock);
+	release_pages(pool, page_nr, num);
+	spin_unlock(&pool->lock);
+}
+
+/**
+ * Enable or disable deferred scrubbing of released pages.
+ * @param pool	Page pool, must have scrubbing on free enabled.
+ * @param defer	True to defer scrubbing, false to scrub synchronously again.
+ *
+ * While enabled, page_free() only marks released pages dirty. Dirty pages are
+ * scrubbed when being reallocated or in batches via page_pool_scrub_dirty().
+ */
+void page_pool_defer_scrubbing(struct page_pool *pool, bool defer)
+{
+	if (!(pool->flags & PAGE_SCRUB_ON_FREE))
+		return;
+
+	if (defer)
+		pool->flags |= PAGE_SCRUB_DEFERRED;
+	else
+		pool->flags &= ~PAGE_SCRUB_DEFERRED;
+}
+
+/**
+ * Scrub a bounded batch of dirty free pages.
+ * @param pool	Page pool to scrub.
+ */
+void page_pool_scrub_dirty(struct page_pool *pool)
+{
+	unsigned int scrubbed = 0;
+	unsigned long word;
+
+	if (pool->dirty_pages == 0)
+		return;
+
+	spin_lock(&pool->lock);
+	for (word = 0; pool->dirty_pages > 0 && scrubbed < PAGE_SCRUB_BATCH;
+	     word++)
+		while (pool->dirty_bitmap[word] != 0 &&
+		       scrubbed < PAGE_SCRUB_BATCH) {
+			scrub_page(pool, word * BITS_PER_LONG +
+					 ffsl(pool->dirty_bitmap[word]));
+			scrubbed++;
+		}
+	spin_unlock(&pool->lock);
+}
+
+/**
+ * Return the number of mem_pool pages in use.
+ *
+ * @return Number of used pages.
+ *
+ * @note Pages cached in per-CPU magazines are accounted as used, they are not
+ * available to page_alloc.
+ *
+ * @see mem_pool_cached_pages
+ */
+unsigned long mem_pool_used_pages(void)
+{
+	unsigned long used;
+
+	spin_lock(&mem_pool.lock);
+	used = mem_pool.used_pages;
+	spin_unlock(&mem_pool.lock);
+
+	return used;
+}
+
+/**
+ * Return the number of used mem_pool pages cached in per-CPU magazines.
+ *
+ * @return Number of cached pages.
+ *
+ * @note The magazines are updated by their CPUs without holding the pool
+ * lock, so the result is only a snapshot.
+ */
+unsigned long mem_pool_cached_pages(void)
+{
+	unsigned long cached = 0;
+	unsigned int cpu;
+
+	for (cpu = 0; cpu < hypervisor_header.max_cpus; cpu++)
+		cached += public_per_cpu(cpu)->page_magazine.count;
+
+	return cached;
+}
+
+/**
+ * Switch page table allocations to the per-CPU page magazines.
+ *
+ * Must be called after all CPUs set up their private mappings and before any
+ * of them starts using this_cpu_public() for paging operations.
+ */
+void paging_enable_page_magazines(void)
+{
+	page_magazines_enabled = true;
+}
+
+/*
+ * Allocate a single page for a page table. Takes it from the magazine of the
+ * calling CPU, refilling the magazine from mem_pool in batches if needed.
+ */
+static void *pt_page_alloc(void)
+{
+	struct page_magazine *mag;
+	void *page;
+
+	if (!page_magazines_enabled)
+		return page_alloc(&mem_pool, 1);
+
+	mag = &this_cpu_public()->page_magazine;
+	if (mag->count == 0) {
+		spin_lock(&mem_pool.lock);
+		while (mag->count < PAGE_MAGAZINE_BATCH) {
+			page = page_alloc_internal(&mem_pool, 1, false);
+			if (!page)
+				break;
+			mag->pages[mag->count++] = page;
+		}
+		spin_unlock(&mem_pool.lock);
+
+		if (mag->count == 0)
+			return NULL;
+	}
+
+	return mag->pages[--mag->count];
+}
+
+/*
+ * Release a page table page into the magazine of the calling CPU, draining
+ * the magazine to mem_pool in batches when it is full.
+ */
+static void pt_page_free(void *page)
+{
+	struct page_magazine *mag;
+
+	clear_bit((page - mem_pool.base_address) / PAGE_SIZE, no_huge_tables);
+
+	/*
+	 * While scrubbing is deferred, pages have to be marked dirty by
+	 * page_free. Magazine pages are always kept scrubbed.
+	 */
+	if (!page_magazines_enabled || mem_pool.flags & PAGE_SCRUB_DEFERRED) {
+		page_free(&mem_pool, page, 1);
+		return;
+	}
+
+	if (mem_pool.flags & PAGE_SCRUB_ON_FREE)
+		memset(page, 0, PAGE_SIZE);
+
+	mag = &this_cpu_public()->page_magazine;
+	if (mag->count == PAGE_MAGAZINE_SIZE) {
+		spin_lock(&mem_pool.lock);
+		while (mag->count > PAGE_MAGAZINE_SIZE - PAGE_MAGAZINE_BATCH) {
+			mag->count--;
+			release_pages(&mem_pool,
+				      (mag->pages[mag->count] -
+				       mem_pool.base_address) / PAGE_SIZE, 1);
+		}
+		spin_unlock(&mem_pool.lock);
 	}
+
+	mag->pages[mag->count++] = page;
+}
+
+static void page_pool_setup_orders(struct page_pool *pool)
+{
+	unsigned long base_page = (unsigned long)pool->base_address >> PAGE_SHIFT;
+	unsigned int order;
+
+	for (pool->num_orders = 1;
+	     pool->num_orders < PAGE_POOL_MAX_ORDERS &&
+	     (1UL << (pool->num_orders - 1)) < pool->pages;
+	     pool->num_orders++)
+		;
+
+	pool->block_bias = base_page & ((1UL << (pool->num_orders - 1)) - 1);
+
+	for (order = 0; order < pool->num_orders; order++)
+		pool->orders[order].blocks =
+			(pool->pages + pool->block_bias + (1UL << order) - 1) >>
+			order;
+}
+
+static unsigned long bitmap_words(unsigned long bits)
+{
+	return (bits + BITS_PER_LONG - 1) / BITS_PER_LONG;
+}
+
+/* Requires pool->base_address, pool->pages and pool->flags to be set. */
+static unsigned long page_pool_metadata_pages(struct page_pool *pool)
+{
+	unsigned long words = 0, bitmap_size;
+	unsigned int order;
+
+	page_pool_setup_orders(pool);
+
+	for (order = 0; order < pool->num_orders; order++) {
+		bitmap_size = bitmap_words(pool->orders[order].blocks);
+		words += bitmap_size + bitmap_words(bitmap_size);
+	}
+	if (pool->flags & PAGE_SCRUB_ON_FREE)
+		words += bitmap_words(pool->pages);
+
+	return PAGES(words * sizeof(unsigned long));
+}
+
+/**
+ * Initialize page pool.
+ * @param pool		Page pool to initialize. @c base_address, @c pages
+ * 			and @c flags must be set.
+ * @param metadata	Memory for the allocator state, sized according to
+ * 			page_pool_metadata_pages().
+ * @param reserved	Number of pages at the beginning of the pool to mark
+ * 			as used.
+ */
+static void page_pool_init(struct page_pool *pool, unsigned long *metadata,
+			   unsigned long reserved)
+{
+	unsigned long bitmap_size;
+	unsigned int order;
+
+	for (order = 0; order < pool->num_orders; order++) {
+		bitmap_size = bitmap_words(pool->orders[order].blocks);
+
+		pool->orders[order].free_bitmap = metadata;
+		metadata += bitmap_size;
+		pool->orders[order].free_summary = metadata;
+		metadata += bitmap_words(bitmap_size);
+		pool->orders[order].free_blocks = 0;
+	}
+	if (pool->flags & PAGE_SCRUB_ON_FREE) {
+		pool->dirty_bitmap = metadata;
+		metadata += bitmap_words(pool->pages);
+	}
+	memset(pool->orders[0].free_bitmap, 0,
+	       (void *)metadata - (void *)pool->orders[0].free_bitmap);
+
+	pool->used_pages = pool->pages;
+	release_pages(pool, reserved, pool->pages - reserved);
 }
 
 /**
@@ -229,12 +669,28 @@ unsigned long paging_virt2phys(const struct paging_structures *pg_structs,
 	}
 }
 
+/* Flush the TLB entries of a modified range in the hypervisor address space. */
+static void flush_hv_tlbs(const struct paging_structures *pg_structs,
+			  unsigned long start, unsigned long pages)
+{
+	if (!pg_structs->hv_paging || pages == 0)
+		return;
+
+	arch_paging_flush_tlbs(start, pages);
+	tlb_flushes++;
+}
+
 static void flush_pt_entry(pt_entry_t pte, unsigned long paging_flags)
 {
 	if (paging_flags & PAGING_COHERENT)
 		arch_paging_flush_cpu_caches(pte, sizeof(*pte));
 }
 
+static int paging_create_internal(const struct paging_structures *pg_structs,
+				  unsigned long phys, unsigned long size,
+				  unsigned long virt, unsigned long access_flags,
+				  unsigned long paging_flags);
+
 static int split_hugepage(bool hv_paging, const struct paging *paging,
 			  pt_entry_t pte, unsigned long virt,
 			  unsigned long paging_flags)
@@ -254,48 +710,121 @@ static int split_hugepage(bool hv_paging, const struct paging *paging,
 
 	sub_structs.hv_paging = hv_paging;
 	sub_structs.root_paging = paging + 1;
-	sub_structs.root_table = page_alloc(&mem_pool, 1);
+	sub_structs.root_table = pt_page_alloc();
 	if (!sub_structs.root_table)
 		return -ENOMEM;
 	paging->set_next_pt(pte, paging_hvirt2phys(sub_structs.root_table));
 	flush_pt_entry(pte, paging_flags);
+	hugepage_splits++;
 
-	return paging_create(&sub_structs, phys, paging->page_size, virt,
-			     flags, paging_flags);
+	/* bypass coalescing, we would immediately undo the split otherwise */
+	return paging_create_internal(&sub_structs, phys, paging->page_size,
+				      virt, flags, paging_flags);
 }
 
-/**
- * Create or modify a page map.
- * @param pg_structs	Descriptor of paging structures to be used.
- * @param phys		Physical address of the region to be mapped.
- * @param size		Size of the region.
- * @param virt		Virtual address the region should be mapped to.
- * @param access_flags	Flags describing the permitted page access, see
- * 			@ref PAGE_ACCESS_FLAGS.
- * @param paging_flags	Flags describing the paging mode, see @ref PAGING_FLAGS.
- *
- * @return 0 on success, negative error code otherwise.
- *
- * @note The function aims at using the largest possible page size for the
- * mapping but does not consolidate with neighboring mappings.
- *
- * @see paging_destroy
- * @see paging_get_guest_pages
+/*
+ * Replace the page table referenced by pte with a single hugepage entry if
+ * all its entries are terminal, map a contiguous, suitably aligned physical
+ * range and share the same access flags. Tables that hold mappings created
+ * without PAGING_HUGE are left alone, they may belong to regions that must
+ * not use hugepages.
  */
-int paging_create(const struct paging_structures *pg_structs,
-		  unsigned long phys, unsigned long size, unsigned long virt,
-		  unsigned long access_flags, unsigned long paging_flags)
+static bool coalesce_table(const struct paging *paging, pt_entry_t pte,
+			   unsigned long virt, unsigned long paging_flags)
+{
+	const struct paging *sub_paging = paging + 1;
+	unsigned long base, flags, offs;
+	page_table_t pt;
+	pt_entry_t sub_pte;
+
+	if (paging->page_size == 0 || sub_paging->page_size == 0)
+		return false;
+
+	virt &= ~((unsigned long)paging->page_size - 1);
+	pt = paging_phys2hvirt(paging->get_next_pt(pte));
+	if (test_bit(((void *)pt - mem_pool.base_address) / PAGE_SIZE,
+		     no_huge_tables))
+		return false;
+
+	sub_pte = sub_paging->get_entry(pt, virt);
+	if (!sub_paging->entry_valid(sub_pte, PAGE_PRESENT_FLAGS))
+		return false;
+	base = sub_paging->get_phys(sub_pte, virt);
+	if (base == INVALID_PHYS_ADDR || (base & (paging->page_size - 1)) != 0)
+		return false;
+	flags = sub_paging->get_flags(sub_pte);
+
+	for (offs = sub_paging->page_size; offs < paging->page_size;
+	     offs += sub_paging->page_size) {
+		sub_pte = sub_paging->get_entry(pt, virt + offs);
+		if (!sub_paging->entry_valid(sub_pte, PAGE_PRESENT_FLAGS) ||
+		    sub_paging->get_phys(sub_pte, virt + offs) != base + offs ||
+		    sub_paging->get_flags(sub_pte) != flags)
+			return false;
+	}
+
+	paging->set_terminal(pte, base, flags);
+	flush_pt_entry(pte, paging_flags);
+	pt_page_free(pt);
+	hugepage_coalesces++;
+	/* the released table may still be held by paging-structure caches */
+	guest_invalidations++;
+
+	return true;
+}
+
+/*
+ * Coalesce the page tables covering virt bottom-up as far as possible, e.g.
+ * a full 4K table into a 2M entry and then a full 2M table into a 1G entry.
+ */
+static void coalesce_hugepages(const struct paging_structures *pg_structs,
+			       unsigned long virt, unsigned long paging_flags)
 {
+	const struct paging *paging[MAX_PAGE_TABLE_LEVELS];
+	pt_entry_t pte[MAX_PAGE_TABLE_LEVELS];
+	page_table_t pt = pg_structs->root_table;
+	int n = 0;
+
+	paging[0] = pg_structs->root_paging;
+	while (1) {
+		pte[n] = paging[n]->get_entry(pt, virt);
+		if (!paging[n]->entry_valid(pte[n], PAGE_PRESENT_FLAGS) ||
+		    paging[n]->get_phys(pte[n], virt) != INVALID_PHYS_ADDR)
+			break;
+		pt = paging_phys2hvirt(paging[n]->get_next_pt(pte[n]));
+		paging[n + 1] = paging[n] + 1;
+		n++;
+	}
+
+	/* the entry at level n is terminal or empty, try its parents */
+	while (--n >= 0)
+		if (!coalesce_table(paging[n], pte[n], virt, paging_flags))
+			break;
+}
+
+/*
+ * Create or modify a page map, see paging_create. Uses the largest possible
+ * page size but does not consolidate with neighboring mappings.
+ */
+static int paging_create_internal(const struct paging_structures *pg_structs,
+				  unsigned long phys, unsigned long size,
+				  unsigned long virt, unsigned long access_flags,
+				  unsigned long paging_flags)
+{
+	unsigned long flush_start, flush_pages = 0;
+	bool invalidated = false;
+	int err = 0;
+
 	phys &= PAGE_MASK;
 	virt &= PAGE_MASK;
 	size = PAGE_ALIGN(size);
+	flush_start = virt;
 
 	while (size > 0) {
 		const struct paging *paging = pg_structs->root_paging;
 		page_table_t pt = pg_structs->root_table;
 		struct paging_structures sub_structs;
 		pt_entry_t pte;
-		int err;
 
 		while (1) {
 			pte = paging->get_entry(pt, virt);
@@ -319,8 +848,16 @@ int paging_create(const struct paging_structures *pg_structs,
 						       paging->page_size,
 						       paging_flags);
 				}
+				if (paging->entry_valid(pte, PAGE_PRESENT_FLAGS))
+					invalidated = true;
 				paging->set_terminal(pte, phys, access_flags);
 				flush_pt_entry(pte, paging_flags);
+				if (!(paging_flags & PAGING_HUGE) &&
+				    !pg_structs->hv_paging &&
+				    pt != pg_structs->root_table)
+					set_bit(((void *)pt -
+						 mem_pool.base_address) /
+						PAGE_SIZE, no_huge_tables);
 				break;
 			}
 			if (paging->entry_valid(pte, PAGE_PRESENT_FLAGS)) {
@@ -328,26 +865,78 @@ int paging_create(const struct paging_structures *pg_structs,
 						     paging, pte, virt,
 						     paging_flags);
 				if (err)
-					return err;
+					goto out;
 				pt = paging_phys2hvirt(
 						paging->get_next_pt(pte));
 			} else {
-				pt = page_alloc(&mem_pool, 1);
-				if (!pt)
-					return -ENOMEM;
+				pt = pt_page_alloc();
+				if (!pt) {
+					err = -ENOMEM;
+					goto out;
+				}
 				paging->set_next_pt(pte,
 						    paging_hvirt2phys(pt));
 				flush_pt_entry(pte, paging_flags);
 			}
 			paging++;
 		}
-		if (pg_structs->hv_paging)
-			arch_paging_flush_page_tlbs(virt);
+		flush_pages += paging->page_size / PAGE_SIZE;
 
 		phys += paging->page_size;
 		virt += paging->page_size;
 		size -= paging->page_size;
 	}
+
+out:
+	if (invalidated && !pg_structs->hv_paging)
+		guest_invalidations++;
+	flush_hv_tlbs(pg_structs, flush_start, flush_pages);
+	return err;
+}
+
+/**
+ * Create or modify a page map.
+ * @param pg_structs	Descriptor of paging structures to be used.
+ * @param phys		Physical address of the region to be mapped.
+ * @param size		Size of the region.
+ * @param virt		Virtual address the region should be mapped to.
+ * @param access_flags	Flags describing the permitted page access, see
+ * 			@ref PAGE_ACCESS_FLAGS.
+ * @param paging_flags	Flags describing the paging mode, see @ref PAGING_FLAGS.
+ *
+ * @return 0 on success, negative error code otherwise.
+ *
+ * @note The function aims at using the largest possible page size for the
+ * mapping. For guest paging structures with @ref PAGING_HUGE, page tables at
+ * the boundaries of the region are additionally coalesced into hugepages if
+ * they turn out to be fully populated with uniform, contiguous mappings that
+ * were all created with @ref PAGING_HUGE. This recovers large mappings of
+ * memory that was split up before, e.g. when it is returned to the root cell.
+ *
+ * @see paging_destroy
+ * @see paging_get_guest_pages
+ */
+int paging_create(const struct paging_structures *pg_structs,
+		  unsigned long phys, unsigned long size, unsigned long virt,
+		  unsigned long access_flags, unsigned long paging_flags)
+{
+	int err;
+
+	err = paging_create_internal(pg_structs, phys, size, virt,
+				     access_flags, paging_flags);
+	if (err || pg_structs->hv_paging || !(paging_flags & PAGING_HUGE) ||
+	    PAGE_ALIGN(size) == 0)
+		return err;
+
+	/*
+	 * Only the first and the last page of the region can be covered by
+	 * tables that were not completely rewritten by this mapping.
+	 */
+	virt &= PAGE_MASK;
+	coalesce_hugepages(pg_structs, virt, paging_flags);
+	coalesce_hugepages(pg_structs, virt + PAGE_ALIGN(size) - PAGE_SIZE,
+			   paging_flags);
+
 	return 0;
 }
 
@@ -371,7 +960,12 @@ int paging_destroy(const struct paging_structures *pg_structs,
 		   unsigned long virt, unsigned long size,
 		   unsigned long paging_flags)
 {
+	unsigned long flush_start, flush_pages = 0;
+	bool invalidated = false;
+	int err = 0;
+
 	size = PAGE_ALIGN(size);
+	flush_start = virt & PAGE_MASK;
 
 	while (size > 0) {
 		const struct paging *paging = pg_structs->root_paging;
@@ -379,7 +973,6 @@ int paging_destroy(const struct paging_structures *pg_structs,
 		unsigned long page_size;
 		pt_entry_t pte;
 		int n = 0;
-		int err;
 
 		/* walk down the page table, saving intermediate tables */
 		pt[0] = pg_structs->root_table;
@@ -420,7 +1013,7 @@ int paging_destroy(const struct paging_structures *pg_structs,
 						     paging, pte, virt,
 						     paging_flags);
 				if (err)
-					return err;
+					goto out;
 			}
 			pt[++n] = paging_phys2hvirt(paging->get_next_pt(pte));
 			paging++;
@@ -430,23 +1023,46 @@ int paging_destroy(const struct paging_structures *pg_structs,
 
 		/* walk up again, clearing entries, releasing empty tables */
 		while (1) {
+			if (paging->entry_valid(pte, PAGE_PRESENT_FLAGS))
+				invalidated = true;
 			paging->clear_entry(pte);
 			flush_pt_entry(pte, paging_flags);
 			if (n == 0 || !paging->page_table_empty(pt[n]))
 				break;
-			page_free(&mem_pool, pt[n], 1);
+			pt_page_free(pt[n]);
 			paging--;
 			pte = paging->get_entry(pt[--n], virt);
 		}
-		if (pg_structs->hv_paging)
-			arch_paging_flush_page_tlbs(virt);
+		flush_pages += page_size / PAGE_SIZE;
 
 		if (page_size > size)
 			break;
 		virt += page_size;
 		size -= page_size;
 	}
-	return 0;
+
+out:
+	if (invalidated && !pg_structs->hv_paging)
+		guest_invalidations++;
+	flush_hv_tlbs(pg_structs, flush_start, flush_pages);
+	return err;
+}
+
+/**
+ * Get the number of guest paging structure updates that invalidated
+ * translations.
+ *
+ * @return Counter that is incremented whenever paging_create or paging_destroy
+ * removed or replaced a valid entry of non-hypervisor paging structures.
+ *
+ * @note Compare the values before and after modifying a guest page map to
+ * find out if the TLBs of the CPUs using that map need to be flushed. Pure
+ * additions do not require this because CPUs do not cache non-present
+ * entries.
+ */
+unsigned long paging_get_guest_invalidations(void)
+{
+	return guest_invalidations;
 }
 
 static unsigned long
@@ -633,8 +1249,9 @@ int paging_map_all_per_cpu(unsigned int cpu, bool enable)
  */
 int paging_init(void)
 {
-	unsigned long n, per_cpu_pages, config_pages, bitmap_pages;
+	unsigned long n, per_cpu_pages, config_pages, metadata_pages;
 	unsigned long vaddr, flags;
+	void *metadata;
 	int err;
 
 	per_cpu_pages = hypervisor_header.max_cpus *
@@ -647,21 +1264,35 @@ int paging_init(void)
 
 	mem_pool.pages = (system_config->hypervisor_memory.size -
 		(__page_pool - (u8 *)&hypervisor_header)) / PAGE_SIZE;
-	bitmap_pages = (mem_pool.pages + BITS_PER_PAGE - 1) / BITS_PER_PAGE;
+	mem_pool.base_address = __page_pool;
+	mem_pool.flags = PAGE_SCRUB_ON_FREE;
+	metadata_pages = page_pool_metadata_pages(&mem_pool);
 
-	if (mem_pool.pages <= per_cpu_pages + config_pages + bitmap_pages)
+	if (mem_pool.pages <= per_cpu_pages + config_pages + metadata_pages)
 		return -ENOMEM;
 
-	mem_pool.base_address = __page_pool;
-	mem_pool.used_bitmap =
-		(unsigned long *)(__page_pool + per_cpu_pages * PAGE_SIZE +
-				  config_pages * PAGE_SIZE);
-	mem_pool.used_pages = per_cpu_pages + config_pages + bitmap_pages;
-	for (n = 0; n < mem_pool.used_pages; n++)
-		set_bit(n, mem_pool.used_bitmap);
-	mem_pool.flags = PAGE_SCRUB_ON_FREE;
+	/*
+	 * The allocator metadata is placed right after the per-CPU data and
+	 * the system configuration. Populating the pool does not scrub, the
+	 * driver handed over all pages zeroed.
+	 */
+	page_pool_init(&mem_pool,
+		       (unsigned long *)(__page_pool +
+					 per_cpu_pages * PAGE_SIZE +
+					 config_pages * PAGE_SIZE),
+		       per_cpu_pages + config_pages + metadata_pages);
+
+	metadata_pages = page_pool_metadata_pages(&remap_pool);
+	metadata = page_alloc(&mem_pool, metadata_pages);
+	if (!metadata)
+		return -ENOMEM;
+	page_pool_init(&remap_pool, metadata, 0);
 
-	remap_pool.used_bitmap = page_alloc(&mem_pool, NUM_REMAP_BITMAP_PAGES);
+	no_huge_tables = page_alloc(&mem_pool,
+				    PAGES(bitmap_words(mem_pool.pages) *
+					  sizeof(unsigned long)));
+	if (!no_huge_tables)
+		return -ENOMEM;
 
 	hv_paging_structs.hv_paging = true;
 	hv_paging_structs.root_table =
@@ -716,13 +1347,76 @@ int paging_init(void)
 	return 0;
 }
 
+static void count_mappings(const struct paging *paging, page_table_t pt,
+			   unsigned int table_pages, unsigned long virt,
+			   unsigned long *huge, unsigned long *small,
+			   unsigned long *tables)
+{
+	const struct paging *sized = paging;
+	unsigned long step;
+	unsigned int n;
+	pt_entry_t pte;
+
+	/* levels without terminal entries have a page_size of 0 */
+	for (step = 1; sized->page_size == 0; sized++)
+		step *= PAGE_SIZE / sizeof(u64);
+	step *= sized->page_size;
+
+	*tables += table_pages;
+
+	for (n = 0; n < table_pages * PAGE_SIZE / sizeof(u64); n++) {
+		pte = paging->get_entry(pt, virt);
+		if (paging->entry_valid(pte, PAGE_PRESENT_FLAGS)) {
+			if (paging->get_phys(pte, virt) == INVALID_PHYS_ADDR)
+				count_mappings(paging + 1, paging_phys2hvirt(
+						paging->get_next_pt(pte)), 1,
+					       virt, huge, small, tables);
+			else if (paging->page_size > PAGE_SIZE)
+				(*huge)++;
+			else
+				(*small)++;
+		}
+		/* stop when the address space is exhausted (32-bit) */
+		if (virt + step < virt)
+			break;
+		virt += step;
+	}
+}
+
 /**
  * Dump usage statistic of the page pools.
  * @param when String that characterizes the associated event.
  */
 void paging_dump_stats(const char *when)
 {
-	printk("Page pool usage %s: mem %ld/%ld, remap %ld/%ld\n", when,
-	       mem_pool.used_pages, mem_pool.pages,
-	       remap_pool.used_pages, remap_pool.pages);
+	const struct paging_structures *root_structs =
+		arch_paging_cell_structs(&root_cell);
+	unsigned long huge = 0, small = 0, tables = 0, shared_tables = 0;
+	const struct paging_structures *pg_structs;
+	unsigned long cell_huge = 0, cell_small = 0;
+	struct cell *cell;
+
+	count_mappings(root_structs->root_paging, root_structs->root_table,
+		       CELL_ROOT_PT_PAGES, 0, &huge, &small, &tables);
+
+	/* every shared page table replaces one of a separate IOMMU copy */
+	for_each_cell(cell)
+		if (arch_paging_cell_structs_shared(cell)) {
+			pg_structs = arch_paging_cell_structs(cell);
+			count_mappings(pg_structs->root_paging,
+				       pg_structs->root_table,
+				       CELL_ROOT_PT_PAGES, 0, &cell_huge,
+				       &cell_small, &shared_tables);
+		}
+
+	printk("Page pool usage %s: mem %ld/%ld (%ld cached, %ld dirty), "
+	       "remap %ld/%ld, TLB flushes %ld\n", when, mem_pool_used_pages(),
+	       mem_pool.pages, mem_pool_cached_pages(), mem_pool.dirty_pages,
+	       remap_pool.used_pages, remap_pool.pages, tlb_flushes);
+	printk("Root cell mappings %s: %ld huge, %ld small, hugepages split "
+	       "%ld, coalesced %ld\n", when, huge, small, hugepage_splits,
+	       hugepage_coalesces);
+	if (shared_tables > 0)
+		printk("Page tables shared with IOMMU %s: %ld pages saved\n",
+		       when, shared_tables);
 }
@@ -137,14 +137,16 @@ static void cpu_init(struct per_cpu *cpu_data)
 	if (err)
 		goto failed;
 
-	/* Make sure any remappings to the temporary regions can be performed
-	 * without allocations of page table pages. */
+	/* Make sure any remappings to the temporary regions and the state
+	 * table page can be performed without allocations of page table
+	 * pages. */
 	err = paging_create(&cpu_data->pg_structs, 0,
-			    NUM_TEMPORARY_PAGES * PAGE_SIZE,
+			    (NUM_TEMPORARY_PAGES + 1) * PAGE_SIZE,
 			    TEMPORARY_MAPPING_BASE, PAGE_NONPRESENT_FLAGS,
 			    PAGING_NON_COHERENT | PAGING_NO_HUGE);
 	if (err)
 		goto failed;
+	cpu_data->state_table_phys = INVALID_PHYS_ADDR;
 
 	printk("OK\n");
 
@@ -175,6 +177,8 @@ static void init_late(void)
 		return;
 	}
 
+	mmio_region_batch_begin(&root_cell);
+
 	for_each_unit(unit) {
 		printk("Initializing unit: %s\n", unit->name);
 		error = unit->init();
@@ -191,6 +195,8 @@ static void init_late(void)
 			return;
 	}
 
+	mmio_region_batch_commit(&root_cell);
+
 	config_commit(&root_cell);
 
 	paging_dump_stats("after late setup");
@@ -242,6 +248,7 @@ int entry(unsigned int cpu_id, struct per_cpu *cpu_data)
 	if (!error && master) {
 		init_late();
 		if (!error) {
+			paging_enable_page_magazines();
 			/*
 			 * Make sure everything was committed before we signal
 			 * the other CPUs that they can continue.
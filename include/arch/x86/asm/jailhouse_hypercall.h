@@ -64,7 +64,14 @@
 #define JAILHOUSE_CPU_STAT_VMEXITS_MSR_OTHER	JAILHOUSE_GENERIC_CPU_STATS + 6
 #define JAILHOUSE_CPU_STAT_VMEXITS_MSR_X2APIC_ICR \
 						JAILHOUSE_GENERIC_CPU_STATS + 7
-#define JAILHOUSE_NUM_CPU_STATS			JAILHOUSE_GENERIC_CPU_STATS + 8
+#define JAILHOUSE_CPU_STAT_MMIO_DECODE_HITS	JAILHOUSE_GENERIC_CPU_STATS + 8
+#define JAILHOUSE_CPU_STAT_MMIO_DECODE_MISSES	JAILHOUSE_GENERIC_CPU_STATS + 9
+#define JAILHOUSE_ARCH_CPU_STATS		JAILHOUSE_GENERIC_CPU_STATS + 10
+
+/* CPU information, reported for the whole cell owning the CPU */
+#define JAILHOUSE_CPU_INFO_LLC_OCCUPANCY	JAILHOUSE_CPU_INFO_ARCH_BASE
+#define JAILHOUSE_CPU_INFO_MBM_TOTAL		JAILHOUSE_CPU_INFO_ARCH_BASE + 1
+#define JAILHOUSE_CPU_INFO_MBM_LOCAL		JAILHOUSE_CPU_INFO_ARCH_BASE + 2
 
 /* CPUID interface */
 #define JAILHOUSE_CPUID_SIGNATURE		0x40000000
@@ -59,7 +59,7 @@
  * Incremented on any layout or semantic change of system or cell config.
  * Also update formats and HEADER_REVISION in pyjailhouse/config_parser.py.
  */
-#define JAILHOUSE_CONFIG_REVISION	14
+#define JAILHOUSE_CONFIG_REVISION	16
 
 #define JAILHOUSE_CELL_NAME_MAXLEN	31
 
@@ -104,11 +104,14 @@ struct jailhouse_cell_desc {
 	__u32 num_cache_regions;
 	__u32 num_irqchips;
 	__u32 num_pio_regions;
+	__u32 num_msr_regions;
 	__u32 num_pci_devices;
 	__u32 num_pci_caps;
 	__u32 num_stream_ids;
 
 	__u32 vpci_irq_base;
+	/* share of memory bandwidth in percent (x86 MBA), 0 for none */
+	__u32 mem_bandwidth;
 
 	__u64 cpu_reset_address;
 	__u64 msg_reply_timeout;
@@ -169,6 +172,7 @@ struct jailhouse_memory {
 #define JAILHOUSE_CACHE_L3_DATA		0x02
 #define JAILHOUSE_CACHE_L3		(JAILHOUSE_CACHE_L3_CODE | \
 					 JAILHOUSE_CACHE_L3_DATA)
+#define JAILHOUSE_CACHE_L2		0x04
 
 #define JAILHOUSE_CACHE_ROOTSHARED	0x0001
 
@@ -315,6 +319,30 @@ struct jailhouse_pio {
 		.length = __length,	\
 	}
 
+#define JAILHOUSE_MSR_READ		0x0001
+#define JAILHOUSE_MSR_WRITE		0x0002
+#define JAILHOUSE_MSR_RW		(JAILHOUSE_MSR_READ | JAILHOUSE_MSR_WRITE)
+
+/*
+ * Range of MSRs the cell may access without interception (x86 only). If a
+ * cell lists any, accesses to all other MSRs are intercepted, and those the
+ * hypervisor does not emulate stop the cell. MSRs the hypervisor has to
+ * intercept, such as PAT, MTRRs, the x2APIC ICR or CAT registers, remain
+ * intercepted.
+ */
+struct jailhouse_msr {
+	__u32 base;
+	__u32 length;
+	__u32 flags;
+} __attribute__((packed));
+
+#define MSR_RANGE(__base, __length, __flags)	\
+	{					\
+		.base = __base,			\
+		.length = __length,		\
+		.flags = __flags,		\
+	}
+
 #define JAILHOUSE_SYSTEM_SIGNATURE	"JHSYS"
 
 /*
@@ -378,6 +406,7 @@ jailhouse_cell_config_size(struct jailhouse_cell_desc *cell)
 		cell->num_cache_regions * sizeof(struct jailhouse_cache) +
 		cell->num_irqchips * sizeof(struct jailhouse_irqchip) +
 		cell->num_pio_regions * sizeof(struct jailhouse_pio) +
+		cell->num_msr_regions * sizeof(struct jailhouse_msr) +
 		cell->num_pci_devices * sizeof(struct jailhouse_pci_device) +
 		cell->num_pci_caps * sizeof(struct jailhouse_pci_capability) +
 		cell->num_stream_ids * sizeof(__u32);
@@ -428,12 +457,20 @@ jailhouse_cell_pio(const struct jailhouse_cell_desc *cell)
 		cell->num_irqchips * sizeof(struct jailhouse_irqchip));
 }
 
+static inline const struct jailhouse_msr *
+jailhouse_cell_msr(const struct jailhouse_cell_desc *cell)
+{
+	return (const struct jailhouse_msr *)
+		((void *)jailhouse_cell_pio(cell) +
+		 cell->num_pio_regions * sizeof(struct jailhouse_pio));
+}
+
 static inline const struct jailhouse_pci_device *
 jailhouse_cell_pci_devices(const struct jailhouse_cell_desc *cell)
 {
 	return (const struct jailhouse_pci_device *)
-		((void *)jailhouse_cell_pio(cell) +
-		 cell->num_pio_regions * sizeof(struct jailhouse_pio));
+		((void *)jailhouse_cell_msr(cell) +
+		 cell->num_msr_regions * sizeof(struct jailhouse_msr));
 }
 
 static inline const struct jailhouse_pci_capability *
@@ -57,9 +57,12 @@
 #define JAILHOUSE_INFO_REMAP_POOL_SIZE		2
 #define JAILHOUSE_INFO_REMAP_POOL_USED		3
 #define JAILHOUSE_INFO_NUM_CELLS		4
+#define JAILHOUSE_INFO_MEM_POOL_DIRTY		5
+#define JAILHOUSE_INFO_MEM_POOL_CACHED		6
 
 /* Hypervisor information type */
 #define JAILHOUSE_CPU_INFO_STATE		0
+#define JAILHOUSE_CPU_INFO_ARCH_BASE		100
 #define JAILHOUSE_CPU_INFO_STAT_BASE		1000
 
 /* CPU state */
@@ -125,4 +128,12 @@
 
 #include <asm/jailhouse_hypercall.h>
 
+/*
+ * Generic CPU statistics added later, appended to the architecture-specific
+ * ones to keep the existing numbers stable.
+ */
+#define JAILHOUSE_CPU_STAT_MMIO_CACHE_HITS	JAILHOUSE_ARCH_CPU_STATS
+#define JAILHOUSE_CPU_STAT_MMIO_CACHE_MISSES	JAILHOUSE_ARCH_CPU_STATS + 1
+#define JAILHOUSE_NUM_CPU_STATS			JAILHOUSE_ARCH_CPU_STATS + 2
+
 #endif /* !_JAILHOUSE_HYPERCALL_H */
@@ -0,0 +1,83 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Measures the round-trip latency of frequent intercepted instructions, i.e.
+ * the cost of a VM exit including its handling by the hypervisor. Run it in
+ * a cell like apic-demo.cell before and after hypervisor changes to compare
+ * the per-reason exit costs.
+ */
+
+#include <inmate.h>
+
+#define ROUNDS			10000
+#define IPI_VECTOR		40
+
+#define MSR_IA32_PAT		0x277
+
+static volatile unsigned int ipis_received;
+
+static void ipi_handler(unsigned int irq)
+{
+	if (irq == IPI_VECTOR)
+		ipis_received++;
+}
+
+static void exit_cpuid(void)
+{
+	u32 eax = 0, ebx, ecx = 0, edx;
+
+	asm volatile("cpuid"
+		: "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx)
+		: : "memory");
+}
+
+static void exit_msr_read(void)
+{
+	read_msr(MSR_IA32_PAT);
+}
+
+static void exit_icr_write(void)
+{
+	irq_send_ipi(cpu_id(), IPI_VECTOR);
+}
+
+static void measure(const char *name, void (*trigger)(void))
+{
+	u64 start, min = (u64)-1, total = 0, delta;
+	unsigned int n;
+
+	for (n = 0; n < ROUNDS; n++) {
+		start = rdtsc_ordered();
+		trigger();
+		delta = rdtsc_ordered() - start;
+		total += delta;
+		if (delta < min)
+			min = delta;
+	}
+	printk("  %s: avg %6llu cycles, min %6llu cycles\n", name,
+	       total / ROUNDS, min);
+}
+
+void inmate_main(void)
+{
+	irq_init(ipi_handler);
+	asm volatile("sti");
+
+	printk("VM exit round-trip latency, %u rounds per measurement:\n",
+	       ROUNDS);
+	measure("CPUID               ", exit_cpuid);
+	measure("RDMSR IA32_PAT      ", exit_msr_read);
+	measure("x2APIC ICR self-IPI ", exit_icr_write);
+
+	while (ipis_received < ROUNDS)
+		cpu_relax();
+	printk("Received %u IPIs\n", ipis_received);
+}
@@ -0,0 +1,126 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2024
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Compares the string operation variants used by the x86 hypervisor core
+ * against the previous bytewise loops.
+ */
+
+#include <inmate.h>
+#include <asm/regs.h>
+
+#define ROUNDS			100000
+#define X86_FEATURE_ERMS	(1 << 9)
+
+static u8 src_buf[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static u8 dst_buf[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+static void memcpy_bytes(void *dest, const void *src, unsigned long n)
+{
+	const u8 *s = src;
+	u8 *d = dest;
+
+	while (n-- > 0)
+		*d++ = *s++;
+}
+
+static void memcpy_movsb(void *dest, const void *src, unsigned long n)
+{
+	asm volatile("rep movsb"
+		: "+D" (dest), "+S" (src), "+c" (n) : : "memory");
+}
+
+static void memcpy_movsq(void *dest, const void *src, unsigned long n)
+{
+	unsigned long qwords = n / 8;
+
+	n %= 8;
+	asm volatile("rep movsq"
+		: "+D" (dest), "+S" (src), "+c" (qwords) : : "memory");
+	asm volatile("rep movsb"
+		: "+D" (dest), "+S" (src), "+c" (n) : : "memory");
+}
+
+static void memset_bytes(void *s, int c, unsigned long n)
+{
+	u8 *p = s;
+
+	while (n-- > 0)
+		*p++ = c;
+}
+
+static void memset_stosb(void *s, int c, unsigned long n)
+{
+	asm volatile("rep stosb"
+		: "+D" (s), "+c" (n) : "a" (c) : "memory");
+}
+
+static void memset_stosq(void *s, int c, unsigned long n)
+{
+	unsigned long qwords = n / 8;
+
+	n %= 8;
+	asm volatile("rep stosq"
+		: "+D" (s), "+c" (qwords)
+		: "a" (0x0101010101010101UL * (u8)c) : "memory");
+	asm volatile("rep stosb"
+		: "+D" (s), "+c" (n) : "a" (c) : "memory");
+}
+
+static void measure_copy(const char *name,
+			 void (*copy)(void *, const void *, unsigned long),
+			 unsigned long size)
+{
+	unsigned int n;
+	u64 start;
+
+	start = rdtsc_ordered();
+	for (n = 0; n < ROUNDS; n++)
+		copy(dst_buf, src_buf, size);
+	printk("  %s, %4lu bytes: %6llu cycles\n", name, size,
+	       (rdtsc_ordered() - start) / ROUNDS);
+}
+
+static void measure_set(const char *name,
+			void (*set)(void *, int, unsigned long),
+			unsigned long size)
+{
+	unsigned int n;
+	u64 start;
+
+	start = rdtsc_ordered();
+	for (n = 0; n < ROUNDS; n++)
+		set(dst_buf, 0, size);
+	printk("  %s, %4lu bytes: %6llu cycles\n", name, size,
+	       (rdtsc_ordered() - start) / ROUNDS);
+}
+
+void inmate_main(void)
+{
+	static const unsigned long sizes[] = { 16, 61, 256, PAGE_SIZE };
+	unsigned int n;
+
+	printk("ERMS %ssupported, %u rounds per measurement\n",
+	       cpuid_ebx(7, 0) & X86_FEATURE_ERMS ? "" : "not ", ROUNDS);
+
+	printk("memcpy:\n");
+	for (n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+		measure_copy("bytes", memcpy_bytes, sizes[n]);
+		measure_copy("movsb", memcpy_movsb, sizes[n]);
+		measure_copy("movsq", memcpy_movsq, sizes[n]);
+	}
+
+	printk("memset:\n");
+	for (n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+		measure_set("bytes", memset_bytes, sizes[n]);
+		measure_set("stosb", memset_stosb, sizes[n]);
+		measure_set("stosq", memset_stosq, sizes[n]);
+	}
+}
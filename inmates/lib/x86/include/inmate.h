@@ -194,6 +194,15 @@ static inline void write_msr(unsigned int msr, u64 val)
 		: "memory");
 }
 
+/* Read the TSC without letting surrounding instructions pass it. */
+static inline u64 rdtsc_ordered(void)
+{
+	u32 lo, hi;
+
+	asm volatile("lfence; rdtsc; lfence" : "=a" (lo), "=d" (hi));
+	return (u64)hi << 32 | lo;
+}
+
 static inline unsigned int cpu_id(void)
 {
 	return read_msr(X2APIC_ID);
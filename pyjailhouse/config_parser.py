@@ -19,7 +19,7 @@ import struct
 from .extendedenum import ExtendedEnum
 
 # Keep the whole file in sync with include/jailhouse/cell-config.h.
-_CONFIG_REVISION = 14
+_CONFIG_REVISION = 16
 JAILHOUSE_X86 = 0
 JAILHOUSE_ARM = 1
 JAILHOUSE_ARM64 = 2
@@ -149,8 +149,17 @@ class PIORegion:
                                                       pio_struct)
 
 
+class MSRRegion:
+    _REGION_FORMAT = 'III'
+    SIZE = struct.calcsize(_REGION_FORMAT)
+
+    def __init__(self, msr_struct):
+        (self.base, self.length, self.flags) = \
+            struct.unpack_from(self._REGION_FORMAT, msr_struct)
+
+
 class CellConfig:
-    _HEADER_FORMAT = '=5sBH32s4xIIIIIIIIIIQ8x32x'
+    _HEADER_FORMAT = '=5sBH32s4xIIIIIIIIIIIIQ8x32x'
 
     def __init__(self, data, root_cell=False):
         self.data = data
@@ -166,10 +175,12 @@ class CellConfig:
              self.num_cache_regions,
              self.num_irqchips,
              self.num_pio_regions,
+             self.num_msr_regions,
              self.num_pci_devices,
              self.num_pci_caps,
              self.num_stream_ids,
              self.vpci_irq_base,
+             self.mem_bandwidth,
              self.cpu_reset_address) = \
                 struct.unpack_from(CellConfig._HEADER_FORMAT, self.data)
             if not root_cell:
@@ -201,6 +212,12 @@ class CellConfig:
             for n in range(self.num_pio_regions):
                 self.pio_regions.append(PIORegion(self.data[pioregion_offs:]))
                 pioregion_offs += PIORegion.SIZE
+
+            msrregion_offs = pioregion_offs
+            self.msr_regions = []
+            for n in range(self.num_msr_regions):
+                self.msr_regions.append(MSRRegion(self.data[msrregion_offs:]))
+                msrregion_offs += MSRRegion.SIZE
         except struct.error:
             raise RuntimeError('Not a %scell configuration' %
                                ('root ' if root_cell else ''))
@@ -0,0 +1,273 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Host-side replay of the hypervisor page pool allocator. It runs the
+ * allocation pattern of repeated cell create/destroy cycles against the
+ * unmodified hypervisor/paging.c and reports timing and failures.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../hypervisor/paging.c"
+
+#define MAX_CELLS		4
+#define MAX_CELL_ALLOCS		512
+#define MAX_ROOT_ALLOCS		1024
+#define RESERVED_PAGES		37
+
+struct allocation {
+	void *page;
+	unsigned int num;
+};
+
+struct replay_cell {
+	unsigned int num_allocs;
+	struct allocation allocs[MAX_CELL_ALLOCS];
+};
+
+static struct replay_cell cells[MAX_CELLS];
+static struct allocation root_allocs[MAX_ROOT_ALLOCS];
+static unsigned int num_root_allocs;
+static unsigned long allocations, failures, misaligned;
+static unsigned long long rand_state = 0x2545f4914f6cdd1dULL;
+
+/* Stubs for the symbols paging.c references outside of the page pool. */
+struct jailhouse_system *system_config;
+struct jailhouse_header hypervisor_header;
+struct cell root_cell;
+unsigned long cache_line_size = 64;
+u8 __page_pool[sizeof(struct per_cpu)];
+
+void printk(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+unsigned long arch_paging_gphys2phys(unsigned long gphys, unsigned long flags)
+{
+	return INVALID_PHYS_ADDR;
+}
+
+const struct paging_structures *arch_paging_cell_structs(struct cell *cell)
+{
+	return NULL;
+}
+
+bool arch_paging_cell_structs_shared(struct cell *cell)
+{
+	return false;
+}
+
+void arch_paging_init(void)
+{
+}
+
+static unsigned int random_range(unsigned int min, unsigned int max)
+{
+	rand_state ^= rand_state >> 12;
+	rand_state ^= rand_state << 25;
+	rand_state ^= rand_state >> 27;
+	return min + (rand_state * 0x2545f4914f6cdd1dULL >> 32) %
+		(max - min + 1);
+}
+
+static bool record(struct allocation *alloc, void *page, unsigned int num)
+{
+	allocations++;
+	if (!page) {
+		failures++;
+		return false;
+	}
+	alloc->page = page;
+	alloc->num = num;
+	return true;
+}
+
+static void cell_alloc(struct replay_cell *cell, unsigned int num,
+		       bool aligned)
+{
+	struct allocation *alloc = &cell->allocs[cell->num_allocs];
+	void *page;
+
+	if (cell->num_allocs >= MAX_CELL_ALLOCS)
+		return;
+	page = aligned ? page_alloc_aligned(&mem_pool, num) :
+		page_alloc(&mem_pool, num);
+	if (aligned && ((unsigned long)page >> PAGE_SHIFT) &
+	    ((1UL << size_to_order(num)) - 1))
+		misaligned++;
+	if (record(alloc, page, num))
+		cell->num_allocs++;
+}
+
+/*
+ * Root cell page tables get split when memory is handed to a new cell. Those
+ * table pages stay with the root cell and are partly released again later.
+ */
+static void root_churn(void)
+{
+	unsigned int n, victim;
+
+	for (n = random_range(0, 8); n > 0; n--) {
+		if (num_root_allocs >= MAX_ROOT_ALLOCS)
+			break;
+		if (record(&root_allocs[num_root_allocs],
+			   page_alloc(&mem_pool, 1), 1))
+			num_root_allocs++;
+	}
+	for (n = random_range(0, 8); n > 0 && num_root_allocs > 0; n--) {
+		victim = random_range(0, num_root_allocs - 1);
+		page_free(&mem_pool, root_allocs[victim].page, 1);
+		root_allocs[victim] = root_allocs[--num_root_allocs];
+	}
+}
+
+static void cell_create(struct replay_cell *cell)
+{
+	unsigned int n;
+
+	cell->num_allocs = 0;
+
+	/* struct cell plus configuration */
+	cell_alloc(cell, random_range(1, 3), false);
+	/* root page table */
+	cell_alloc(cell, CELL_ROOT_PT_PAGES, true);
+	/* IOMMU tables with alignment requirements */
+	cell_alloc(cell, 1 << random_range(0, 2), true);
+	/* MMIO dispatcher and PCI device arrays */
+	cell_alloc(cell, random_range(1, 4), false);
+	cell_alloc(cell, random_range(1, 2), false);
+
+	for (n = random_range(8, 256); n > 0; n--) {
+		cell_alloc(cell, 1, false);
+		if (random_range(0, 31) == 0)
+			root_churn();
+	}
+
+	/* ivshmem and comm region */
+	cell_alloc(cell, 1, false);
+	if (random_range(0, 3) == 0)
+		cell_alloc(cell, random_range(8, 32), false);
+}
+
+static void cell_destroy(struct replay_cell *cell)
+{
+	unsigned int n, victim;
+	struct allocation tmp;
+
+	/* page tables are released in walk order, not in allocation order */
+	for (n = 0; n < cell->num_allocs; n++) {
+		victim = random_range(n, cell->num_allocs - 1);
+		tmp = cell->allocs[n];
+		cell->allocs[n] = cell->allocs[victim];
+		cell->allocs[victim] = tmp;
+	}
+	for (n = 0; n < cell->num_allocs; n++)
+		page_free(&mem_pool, cell->allocs[n].page, cell->allocs[n].num);
+	cell->num_allocs = 0;
+	root_churn();
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [CYCLES [POOL_PAGES [SEED]]]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long cycles = 2000, pages = 16384, n;
+	unsigned long metadata_pages, free_pages;
+	struct timespec start, end;
+	unsigned int order;
+	double elapsed;
+	void *memory;
+
+	if (argc > 4)
+		usage(argv[0]);
+	if (argc > 1)
+		cycles = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		pages = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		rand_state = strtoull(argv[3], NULL, 0) | 1;
+	if (cycles == 0 || pages <= RESERVED_PAGES)
+		usage(argv[0]);
+
+	memory = aligned_alloc(PAGE_SIZE, pages * PAGE_SIZE);
+	if (!memory) {
+		perror("aligned_alloc");
+		return 1;
+	}
+
+	/*
+	 * Scrubbing is left off so that the replay measures the allocator
+	 * rather than memset.
+	 */
+	mem_pool.base_address = memory;
+	mem_pool.pages = pages;
+	mem_pool.flags = 0;
+	metadata_pages = page_pool_metadata_pages(&mem_pool);
+	page_pool_init(&mem_pool, malloc(metadata_pages * PAGE_SIZE),
+		       RESERVED_PAGES);
+
+	for (n = 0; n < MAX_CELLS; n++)
+		cell_create(&cells[n]);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (n = 0; n < cycles; n++) {
+		struct replay_cell *cell =
+			&cells[random_range(0, MAX_CELLS - 1)];
+
+		cell_destroy(cell);
+		cell_create(cell);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) * 1e3 +
+		(end.tv_nsec - start.tv_nsec) / 1e6;
+
+	printf("cycles: %lu, pool pages: %lu\n", cycles, pages);
+	printf("allocations: %lu, failed: %lu, misaligned: %lu\n",
+	       allocations, failures, misaligned);
+	printf("time: %.2f ms (%.1f ns per allocation)\n", elapsed,
+	       elapsed * 1e6 / allocations);
+	printf("free blocks per order:");
+	for (order = 0; order < mem_pool.num_orders; order++)
+		printf(" %lu", mem_pool.orders[order].free_blocks);
+	printf("\n");
+
+	for (n = 0; n < MAX_CELLS; n++)
+		cell_destroy(&cells[n]);
+	while (num_root_allocs > 0)
+		page_free(&mem_pool, root_allocs[--num_root_allocs].page, 1);
+
+	free_pages = 0;
+	for (order = 0; order < mem_pool.num_orders; order++)
+		free_pages += mem_pool.orders[order].free_blocks << order;
+	if (misaligned > 0)
+		return 1;
+	if (mem_pool.used_pages != RESERVED_PAGES ||
+	    free_pages != pages - RESERVED_PAGES) {
+		printf("ERROR: pool not fully released (used %lu, free %lu)\n",
+		       mem_pool.used_pages, free_pages);
+		return 1;
+	}
+
+	return 0;
+}